@@ -0,0 +1,138 @@
+"""
+黑匣子事件记录解码（固件 blackbox.c）
+
+固件在 USART2 收到 'B' 后按行导出：
+  BB,H,F,<hex>   Flash 中上一次转储的头部，随后 BB,F,<hex> 为其记录
+  BB,H,R,<hex>   当前 RAM 缓冲的头部，随后 BB,R,<hex> 为其记录
+
+用法：
+  python blackbox_decode.py dump.log              # 解码已保存的串口输出
+  python blackbox_decode.py --port COM5           # 发送 'B' 并实时读取（需要 pyserial）
+  python blackbox_decode.py dump.log --csv out.csv
+"""
+import argparse
+import csv
+import struct
+import sys
+import time
+
+# ---- 与 blackbox.h / main.c 保持一致 ----
+HEADER_FMT = '<IIIHBBHH'     # magic, seq, t_ms, count, reason, reserved, crc, exported
+RECORD_FMT = '<IBBhhh'       # t_ms, type, arg, v0, v1, v2
+BB_MAGIC = 0x31584242
+
+STATES = ['DETECT', 'CONFIGURE', 'VERIFY', 'MEASURE', 'WAIT', 'ABORT']
+FLUSH_REASONS = {0: '-', 1: 'reset', 2: 'hardfault', 3: 'watchdog'}
+BOOT_KINDS = {0: 'cold', 1: 'warm', 2: 'warm-skip'}
+
+
+def state_name(i):
+    return STATES[i] if 0 <= i < len(STATES) else str(i)
+
+
+def describe(ev, arg, v):
+    if ev == 1:
+        return 'BOOT', f'{BOOT_KINDS.get(arg, arg)} csr_hi=0x{v[0] & 0xFFFF:04X}'
+    if ev == 2:
+        return 'STATE', f'{state_name(v[0])} -> {state_name(arg)} dwell={v[1]} ms'
+    if ev == 3:
+        if arg == 1:
+            return 'AT', f'timeout cmd#{v[0]} fails={v[1]}'
+        return 'AT', f'sequence done cmds={v[0]} fails={v[1]}'
+    if ev == 4:
+        return 'WDOG', f'{"MCU reset" if arg else "sensor recover"} no_parse={v[0] * 100} ms'
+    if ev == 5:
+        return 'VERIFY', f'reconfig#{arg} t1={v[0]} fail_b_max={v[1]}'
+    if ev == 6:
+        return 'STOP', f'{"ISR" if arg else "main"} a_f={v[0]} stop={v[1]} lead={v[2]}'
+    if ev == 7:
+        return 'REMOVAL', f'{"far" if arg == 1 else "lost"} a={v[0]} b={v[1]} filled={v[2] * 100} ms'
+    if ev == 8:
+        return 'FLUSH', FLUSH_REASONS.get(arg, str(arg))
+    return f'EV{ev}', f'arg={arg} v={v}'
+
+
+def parse_lines(lines):
+    """返回 [(src, header_dict, [records])]"""
+    blocks = []
+    cur = None
+    for line in lines:
+        line = line.strip()
+        if not line.startswith('BB,'):
+            continue
+        parts = line.split(',')
+        try:
+            if parts[1] == 'H':
+                raw = bytes.fromhex(parts[3])
+                magic, seq, t_ms, count, reason, _, crc, exported = struct.unpack(HEADER_FMT, raw)
+                if magic != BB_MAGIC:
+                    continue
+                cur = (parts[2], dict(seq=seq, t_ms=t_ms, count=count, reason=reason,
+                                      first_export=(exported == 0xFFFF)), [])
+                blocks.append(cur)
+            elif cur is not None and parts[1] == cur[0]:
+                cur[2].append(struct.unpack(RECORD_FMT, bytes.fromhex(parts[2])))
+        except (ValueError, IndexError, struct.error):
+            continue  # 串口截断的行
+    return blocks
+
+
+def read_serial(port, baud, wait_s):
+    import serial  # pyserial
+    with serial.Serial(port, baud, timeout=0.2) as ser:
+        ser.reset_input_buffer()
+        ser.write(b'B')
+        end = time.time() + wait_s
+        lines = []
+        while time.time() < end:
+            line = ser.readline().decode('ascii', errors='ignore')
+            if line:
+                lines.append(line)
+                end = max(end, time.time() + 0.5)  # 仍有数据则继续读
+        return lines
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Decode blackbox dumps from the dispenser firmware')
+    ap.add_argument('log', nargs='?', help='保存的串口输出（省略时使用 --port）')
+    ap.add_argument('--port', help='串口（发送 B 并读取导出）')
+    ap.add_argument('--baud', type=int, default=115200)
+    ap.add_argument('--wait', type=float, default=2.0, help='串口读取等待时间（秒）')
+    ap.add_argument('--csv', help='同时写出 CSV')
+    args = ap.parse_args()
+
+    if args.port:
+        lines = read_serial(args.port, args.baud, args.wait)
+    elif args.log:
+        with open(args.log, encoding='utf-8', errors='ignore') as f:
+            lines = f.readlines()
+    else:
+        ap.error('需要日志文件或 --port')
+
+    blocks = parse_lines(lines)
+    if not blocks:
+        print('no blackbox data found', file=sys.stderr)
+        return 1
+
+    rows = []
+    for src, hdr, recs in blocks:
+        title = 'flash dump' if src == 'F' else 'live buffer'
+        if src == 'F' and not hdr['first_export']:
+            title += ' (exported before)'
+        print(f"=== {title}: seq={hdr['seq']} reason={FLUSH_REASONS.get(hdr['reason'], hdr['reason'])} "
+              f"records={len(recs)}/{hdr['count']} at {hdr['t_ms']} ms ===")
+        for t_ms, ev, arg, v0, v1, v2 in recs:
+            name, text = describe(ev, arg, (v0, v1, v2))
+            print(f'{t_ms:>10} ms  {name:<8} {text}')
+            rows.append([src, hdr['seq'], t_ms, name, arg, v0, v1, v2, text])
+
+    if args.csv:
+        with open(args.csv, 'w', newline='', encoding='utf-8') as f:
+            w = csv.writer(f)
+            w.writerow(['src', 'seq', 't_ms', 'event', 'arg', 'v0', 'v1', 'v2', 'text'])
+            w.writerows(rows)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
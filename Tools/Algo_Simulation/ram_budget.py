@@ -0,0 +1,224 @@
+"""
+固件 RAM 预算：静态区 + 各任务最坏栈深 + 堆，检查是否放得下 20KB
+
+输入为编译器输出（不需要链接）：
+  *.s   : 汇编（-S -fdata-sections），按 .size 统计每个 .data/.bss 符号
+  *.su  : 每个函数的栈帧（-fstack-usage）
+  *.ci  : 调用图（-fcallgraph-info=su），求各入口的最坏调用链
+
+CubeIDE 工程：在 MCU GCC Compiler 的 Miscellaneous 中加入
+  -save-temps=obj -fstack-usage -fcallgraph-info=su
+编译后直接把 Debug/Core/Src 交给本脚本。
+没有 ARM 工具链时可在 PC 上按 32 位、ARM EABI 的对齐规则生成（见 README），
+结构体布局与 Cortex-M3 一致，栈帧为 i386 的，只作为参考。
+
+用法：
+  python ram_budget.py DIR [DIR...] [--ld ../../water_dispenser3/STM32F103C8TX_FLASH.ld]
+                       [--heap 8192] [--root task_control ...] [--top 20]
+
+函数指针调用按 INDIRECT 表展开（状态机处理函数、调度任务）；
+库函数与 FreeRTOS 内核函数没有栈信息，以 "+?" 列出，可用 --extern name=bytes 补充。
+"""
+import argparse
+import glob
+import os
+import re
+from collections import defaultdict
+
+# ---- 与 main.c 保持一致：函数指针调用的可能目标 ----
+# 状态机处理函数（fsm_dispatch/fsm_transition 可能被内联进调用者，调用者同样按此展开）
+STATE_FN = r'^(detect|configure|verify|measure|wait|abort)_(entry|exit|event)$'
+UART_DMA_CB = r'^UART_DMA\w+$'   # HAL 内部登记的 DMA 回调
+INDIRECT = {
+    'fsm_transition': STATE_FN,
+    'fsm_dispatch': STATE_FN,
+    'main': STATE_FN,
+    'task_control': STATE_FN,
+    'sched_run': r'^job_\w+$',
+    'fast_cutoff_feed': r'^pump_off_isr$',
+    'tlm_send': r'^uart2_write$',
+    'dump_line': r'^bb_write_uart$',
+    'HAL_DMA_IRQHandler': UART_DMA_CB,
+    'HAL_DMA_Abort_IT': UART_DMA_CB,
+    'HAL_UART_IRQHandler': UART_DMA_CB,
+}
+
+DEFAULT_ROOTS = ['main', 'task_control', 'task_ingest', 'task_config', 'task_telemetry',
+                 'USART1_IRQHandler', 'DMA1_Channel5_IRQHandler', 'SysTick_Handler',
+                 'HardFault_Handler']
+
+EXC_FRAME = 32  # Cortex-M3 异常入栈（8 个寄存器）
+
+SEC_RE = re.compile(r'^\s*\.section\s+([^,\s]+)')
+SIZE_RE = re.compile(r'^\s*\.size\s+([\w.$]+),\s*(\d+)\s*$')
+NODE_RE = re.compile(r'node: \{ title: "([^"]+)" label: "([^"]*)"')
+EDGE_RE = re.compile(r'edge: \{ sourcename: "([^"]+)" targetname: "([^"]+)"')
+BYTES_RE = re.compile(r'\\n(\d+) bytes \(([\w,]+)\)')
+
+
+def static_ram(dirs):
+    syms = []
+    for d in dirs:
+        for f in sorted(glob.glob(os.path.join(d, '*.s'))):
+            sec = None
+            for line in open(f, errors='replace'):
+                m = SEC_RE.match(line)
+                if m:
+                    sec = m.group(1)
+                    continue
+                s = line.strip()
+                if s in ('.data', '.bss', '.text'):
+                    sec = s
+                    continue
+                m = SIZE_RE.match(line)
+                if m and sec and (sec.startswith('.bss') or sec.startswith('.data')):
+                    kind = '.bss' if sec.startswith('.bss') else '.data'
+                    syms.append((int(m.group(2)), kind, os.path.basename(f)[:-2], m.group(1)))
+    return syms
+
+
+def load_callgraph(dirs):
+    frame = {}                 # 节点 -> 栈帧字节数
+    name = {}                  # 节点 -> 函数名
+    dynamic = set()            # 栈帧大小不定（alloca/VLA）
+    edges = defaultdict(set)
+    for d in dirs:
+        for f in sorted(glob.glob(os.path.join(d, '*.ci'))):
+            for line in open(f, errors='replace'):
+                m = NODE_RE.search(line)
+                if m:
+                    title, label = m.group(1), m.group(2)
+                    name[title] = label.split('\\n')[0]
+                    b = BYTES_RE.search(label)
+                    if b:
+                        frame[title] = int(b.group(1))
+                        if 'bounded' not in b.group(2) and 'dynamic' in b.group(2):
+                            dynamic.add(title)
+                    continue
+                m = EDGE_RE.search(line)
+                if m:
+                    edges[m.group(1)].add(m.group(2))
+    # 外部调用只有函数名：映射到定义该全局函数的节点
+    by_name = defaultdict(list)
+    for t in frame:
+        by_name[name[t]].append(t)
+    return frame, name, dynamic, edges, by_name
+
+
+def worst_stack(root, cg, extern):
+    frame, name, dynamic, edges, by_name = cg
+    indirect = {k: re.compile(v) for k, v in INDIRECT.items()}
+    memo = {}
+    unknown = set()
+    cycles = set()
+
+    def resolve(t):
+        if t in frame:
+            return [t]
+        if t in by_name and len(by_name[t]) == 1:
+            return by_name[t]
+        return None
+
+    def visit(node, stack):
+        if node in memo:
+            return memo[node]
+        if node in stack:
+            cycles.add(name.get(node, node))
+            return 0, []
+        stack.add(node)
+        best, path = 0, []
+        targets = set(edges.get(node, ()))
+        fn = name.get(node, node)
+        if '__indirect_call' in targets:
+            targets.discard('__indirect_call')
+            pat = indirect.get(fn)
+            if pat:
+                targets |= {t for t in frame if pat.match(name[t])}
+            else:
+                unknown.add(fn + ' -> (indirect)')
+        for t in targets:
+            r = resolve(t)
+            if r is None:
+                if t in extern:
+                    d, p = extern[t], [t]
+                else:
+                    unknown.add(t)
+                    continue
+            else:
+                d, p = visit(r[0], stack)
+            if d > best:
+                best, path = d, p
+        stack.discard(node)
+        res = (frame.get(node, 0) + best, [fn] + path)
+        memo[node] = res
+        return res
+
+    r = resolve(root)
+    if r is None:
+        return None
+    depth, path = visit(r[0], set())
+    return depth, path, sorted(unknown), sorted(cycles), r[0] in dynamic
+
+
+def ld_reserve(path):
+    txt = open(path, errors='replace').read()
+    def val(sym):
+        m = re.search(sym + r'\s*=\s*(0x[0-9a-fA-F]+|\d+)', txt)
+        return int(m.group(1), 0) if m else 0
+    m = re.search(r'RAM\s*\(\w+\)\s*:\s*ORIGIN\s*=\s*\w+,\s*LENGTH\s*=\s*(\d+)K', txt)
+    ram = int(m.group(1)) * 1024 if m else 20 * 1024
+    return ram, val('_Min_Heap_Size'), val('_Min_Stack_Size')
+
+
+def main():
+    ap = argparse.ArgumentParser(description='固件 RAM 预算')
+    ap.add_argument('dirs', nargs='+', help='含 .s/.su/.ci 的目录')
+    ap.add_argument('--ld', default=os.path.join(os.path.dirname(__file__),
+                                                 '../../water_dispenser3/STM32F103C8TX_FLASH.ld'))
+    ap.add_argument('--heap', type=int, default=0, help='configTOTAL_HEAP_SIZE（FreeRTOS 构建）')
+    ap.add_argument('--root', action='append', help='栈深入口函数（默认主循环/任务/中断）')
+    ap.add_argument('--extern', action='append', default=[], help='库函数栈深 name=bytes')
+    ap.add_argument('--top', type=int, default=20)
+    args = ap.parse_args()
+
+    syms = static_ram(args.dirs)
+    data = sum(s[0] for s in syms if s[1] == '.data')
+    bss = sum(s[0] for s in syms if s[1] == '.bss')
+    print('== 静态区 ==')
+    for n, kind, mod, sym in sorted(syms, reverse=True)[:args.top]:
+        print('  %6d  %-5s  %-20s %s' % (n, kind, mod, sym))
+    print('  .data %d + .bss %d = %d 字节（%d 个符号）' % (data, bss, data + bss, len(syms)))
+
+    extern = {}
+    for e in args.extern:
+        k, v = e.split('=')
+        extern[k] = int(v)
+    cg = load_callgraph(args.dirs)
+    print('\n== 最坏栈深（不含库函数） ==')
+    irq_max = 0
+    for root in (args.root or DEFAULT_ROOTS):
+        r = worst_stack(root, cg, extern)
+        if r is None:
+            continue
+        depth, path, unknown, cycles, dyn = r
+        if root.endswith('_Handler') or root.endswith('IRQHandler'):
+            irq_max = max(irq_max, depth + EXC_FRAME)
+        print('  %-26s %5d 字节%s  %s' % (root, depth, ' (动态)' if dyn else '', ' > '.join(path)))
+        if cycles:
+            print('    递归: %s' % ', '.join(cycles))
+        if unknown:
+            print('    +? %s' % ', '.join(unknown))
+    if irq_max:
+        print('  中断（含异常入栈，不嵌套）最深 %d 字节' % irq_max)
+
+    if os.path.exists(args.ld):
+        ram, min_heap, min_stack = ld_reserve(args.ld)
+        total = data + bss + args.heap + min_heap + min_stack
+        print('\n== 预算（%s） ==' % os.path.basename(args.ld))
+        print('  静态 %d + FreeRTOS 堆 %d + _Min_Heap_Size %d + _Min_Stack_Size %d = %d / %d 字节，余 %d'
+              % (data + bss, args.heap, min_heap, min_stack, total, ram, ram - total))
+        print('  未计入：C 库与 FreeRTOS 内核自身的 .data/.bss')
+
+
+if __name__ == '__main__':
+    main()
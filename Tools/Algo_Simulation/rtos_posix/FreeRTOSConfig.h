@@ -0,0 +1,42 @@
+/*
+ * rtos_smoke.c 使用的 FreeRTOS 配置（GCC/Posix 移植，Linux 上运行）
+ * 调度相关项与固件（app_rtos.h 注释中的 CubeMX 配置）一致：抢占、1kHz 节拍、不用软件定时器；
+ * 主机线程栈远大于 Cortex-M3，堆与栈大小单独放大，RAM 数字以 ram_budget.py 为准
+ */
+#ifndef FREERTOS_CONFIG_H
+#define FREERTOS_CONFIG_H
+
+#include <assert.h>
+
+#define configUSE_PREEMPTION                    1
+#define configUSE_TIME_SLICING                  1
+#define configUSE_IDLE_HOOK                     0
+#define configUSE_TICK_HOOK                     0
+#define configTICK_RATE_HZ                      1000
+#define configMAX_PRIORITIES                    5
+#define configMINIMAL_STACK_SIZE                ((unsigned short)4096)
+#define configTOTAL_HEAP_SIZE                   ((size_t)(1024 * 1024))
+#define configMAX_TASK_NAME_LEN                 16
+#define configUSE_16_BIT_TICKS                  0
+#define configUSE_MUTEXES                       0
+#define configUSE_COUNTING_SEMAPHORES           0
+#define configUSE_TASK_NOTIFICATIONS            1
+#define configQUEUE_REGISTRY_SIZE               0
+#define configUSE_TIMERS                        0
+#define configUSE_CO_ROUTINES                   0
+#define configSUPPORT_DYNAMIC_ALLOCATION        1
+#define configSUPPORT_STATIC_ALLOCATION         0
+#define configUSE_MALLOC_FAILED_HOOK            1
+#define configCHECK_FOR_STACK_OVERFLOW          0   // Posix 移植的任务运行在 pthread 栈上，检测无意义
+#define configUSE_TRACE_FACILITY                0
+#define configGENERATE_RUN_TIME_STATS           0
+
+#define INCLUDE_vTaskDelay                      1
+#define INCLUDE_vTaskDelayUntil                 1
+#define INCLUDE_xTaskDelayUntil                 1
+#define INCLUDE_uxTaskGetStackHighWaterMark     1
+#define INCLUDE_vTaskSuspend                    1
+
+#define configASSERT(x) assert(x)
+
+#endif // FREERTOS_CONFIG_H
@@ -0,0 +1,244 @@
+/*
+ * 固件 FreeRTOS 任务图（main.c，USE_FREERTOS=1）在 Linux 上的冒烟测试，使用 FreeRTOS 的 GCC/Posix 移植
+ * 任务、优先级、队列长度取自 app_rtos.h，消息结构与 main.c 相同：
+ *  ingest    : 每 FRAME_MS 产生一帧送入 frame_queue（代替 USART1 空闲中断通知 + 帧解析）
+ *  control   : 取帧并检查序号连续；每 AT_EVERY 帧向 at_cmd_queue 投递一组 AT 命令，等待完成通知
+ *  config    : 逐条取命令，阻塞 AT_RESP_MS 模拟等待 OK
+ *  telemetry : 从 log_queue 取日志，每行忙等 LOG_BUSY_US 模拟 USART2 发送（最低优先级）
+ * 检查：
+ *  - 帧不丢不乱序（frame_queue 从不满），ingest 发出到 control 取走不超过 1 个节拍，
+ *    即 config 阻塞与 telemetry 忙等都不会推迟 control（优先级与抢占正确）
+ *  - AT 命令按投递顺序完成，每组完成后 control 收到通知
+ *  - 日志突发超过 log_queue 容量时只丢日志，发送方不阻塞
+ *
+ * 编译运行（在本目录下，K 为 FreeRTOS-Kernel 源码目录，V10.4 及以上）：
+ *   P=$K/portable/ThirdParty/GCC/Posix
+ *   gcc -O2 -pthread -I. -I../../../water_dispenser3/Core/Inc -I$K/include -I$P -I$P/utils \
+ *       rtos_smoke.c $K/tasks.c $K/queue.c $K/list.c $P/port.c $P/utils/wait_for_event.c \
+ *       $K/portable/MemMang/heap_4.c -o rtos_smoke
+ *   ./rtos_smoke [秒数，默认 10]
+ *
+ * 主机上的栈/堆数字不代表 Cortex-M3（栈按 FreeRTOSConfig.h 放大），只打印作参考
+ */
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "app_rtos.h"
+
+#define FRAME_MS        100     // 传感器帧间隔
+#define AT_EVERY        20      // 每 20 帧下发一组命令（相当于一次 CONFIGURE）
+#define AT_BATCH        7       // 与 at_queue_sensor_defaults 条数相同
+#define AT_RESP_MS      30      // config 等待 OK 的阻塞时间
+#define LOG_BUSY_US     8000    // 96 字节 @115200 约 8ms
+#define LOG_BURST       (LOG_QUEUE_LEN + 8) // 每组命令时的日志突发，必然超过队列容量
+#define STACK_SCALE     16      // 主机线程栈放大倍数
+
+/* ---- 与 main.c 相同的消息结构 ---- */
+#define S_COUNT         224
+#define AT_QUEUE_MAX    8
+#define AT_CMD_LEN      24
+
+typedef struct {
+    int a;
+    int b;
+    int16_t s[S_COUNT];
+    bool valid;
+} SensorFrame;
+
+typedef struct {
+    uint8_t     result;
+    uint32_t    t_ms;
+    SensorFrame frame;
+} FrameMsg;
+
+typedef struct {
+    uint8_t len;
+    char text[LOG_LINE_LEN];
+} LogLine;
+
+typedef struct {
+    char cmd[AT_CMD_LEN];
+    uint16_t timeout_ms;
+} AtCmd;
+
+static QueueHandle_t log_queue, frame_queue, at_cmd_queue;
+static TaskHandle_t control_h, ingest_h, config_h, telemetry_h;
+
+static volatile uint8_t at_pending = 0;     // 临界区内修改（与 main.c 相同）
+static volatile uint32_t at_batches_done = 0;
+
+// 统计
+static uint32_t frames_tx, frames_rx, frame_drop, frame_order_err;
+static TickType_t lat_max;
+static uint32_t at_cmds_tx, at_cmds_done, at_order_err;
+static uint32_t logs_out, log_drop;
+static uint32_t run_s = 10;
+
+static void log_line(const char *fmt, ...) {
+    LogLine l;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(l.text, sizeof(l.text), fmt, ap);
+    va_end(ap);
+    if (n < 0) n = 0;
+    if (n >= (int)sizeof(l.text)) n = (int)sizeof(l.text) - 1;
+    l.len = (uint8_t)n;
+    if (xQueueSend(log_queue, &l, 0) != pdPASS) log_drop++; // 与固件相同：满则丢弃，不阻塞
+}
+
+static void busy_wait_us(uint32_t us) {
+    struct timespec t0, t;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &t);
+    } while ((uint64_t)(t.tv_sec - t0.tv_sec) * 1000000u + (uint64_t)(t.tv_nsec - t0.tv_nsec) / 1000u < us);
+}
+
+static void task_ingest(void *arg) {
+    (void)arg;
+    static FrameMsg msg;
+    TickType_t last = xTaskGetTickCount();
+    for (;;) {
+        vTaskDelayUntil(&last, pdMS_TO_TICKS(FRAME_MS));
+        msg.result = 1;
+        msg.frame.a = (int)++frames_tx;
+        msg.frame.b = 1000;
+        for (int i = 0; i < S_COUNT; i++) msg.frame.s[i] = (int16_t)(i + frames_tx);
+        msg.frame.valid = true;
+        msg.t_ms = xTaskGetTickCount();
+        if (xQueueSend(frame_queue, &msg, 0) != pdPASS) {
+            frame_drop++;
+        } else {
+            xTaskNotifyGive(control_h);
+        }
+    }
+}
+
+static void at_submit_batch(void) {
+    for (int i = 0; i < AT_BATCH; i++) {
+        AtCmd c;
+        snprintf(c.cmd, sizeof(c.cmd), "AT+T%lu\r\n", (unsigned long)++at_cmds_tx);
+        c.timeout_ms = AT_RESP_MS * 3;
+        taskENTER_CRITICAL();
+        at_pending++;
+        taskEXIT_CRITICAL();
+        if (xQueueSend(at_cmd_queue, &c, 0) != pdPASS) {
+            taskENTER_CRITICAL();
+            at_pending--;
+            taskEXIT_CRITICAL();
+            at_order_err++;
+        }
+    }
+    for (int i = 0; i < LOG_BURST; i++) log_line("[SMOKE] burst %d\r\n", i);
+}
+
+static void task_control(void *arg) {
+    (void)arg;
+    static FrameMsg msg;
+    uint32_t batches_seen = 0;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(FRAME_MS * 2));
+        while (xQueueReceive(frame_queue, &msg, 0) == pdPASS) {
+            TickType_t lat = xTaskGetTickCount() - msg.t_ms;
+            if (lat > lat_max) lat_max = lat;
+            if (msg.frame.a != (int)(frames_rx + 1) || msg.frame.s[S_COUNT - 1] != (int16_t)(S_COUNT - 1 + msg.frame.a)) {
+                frame_order_err++;
+            }
+            frames_rx = (uint32_t)msg.frame.a;
+            log_line("a=%d\r\n", msg.frame.a);
+            if (frames_rx % AT_EVERY == 0 && at_pending == 0) at_submit_batch();
+        }
+        if (at_batches_done != batches_seen) {
+            batches_seen = at_batches_done;
+            log_line("[SMOKE] AT batch %lu done\r\n", (unsigned long)batches_seen);
+        }
+    }
+}
+
+static void task_config(void *arg) {
+    (void)arg;
+    AtCmd c;
+    for (;;) {
+        if (xQueueReceive(at_cmd_queue, &c, portMAX_DELAY) != pdPASS) continue;
+        vTaskDelay(pdMS_TO_TICKS(AT_RESP_MS)); // 阻塞等待 OK：低优先级任务阻塞不应影响 control
+        unsigned long n = strtoul(c.cmd + 4, NULL, 10);
+        if (n != at_cmds_done + 1) at_order_err++;
+        at_cmds_done = (uint32_t)n;
+        log_line("[AT] %lu OK\r\n", n);
+        taskENTER_CRITICAL();
+        uint8_t left = --at_pending;
+        taskEXIT_CRITICAL();
+        if (left == 0) {
+            at_batches_done++;
+            xTaskNotifyGive(control_h);
+        }
+    }
+}
+
+static void task_telemetry(void *arg) {
+    (void)arg;
+    LogLine l;
+    for (;;) {
+        if (xQueueReceive(log_queue, &l, portMAX_DELAY) != pdPASS) continue;
+        busy_wait_us(LOG_BUSY_US); // 阻塞发送占满 CPU，只有更高优先级任务能抢占
+        logs_out++;
+    }
+}
+
+static void task_monitor(void *arg) {
+    (void)arg;
+    vTaskDelay(pdMS_TO_TICKS(run_s * 1000u));
+
+    uint32_t expect_batches = (uint32_t)(frames_rx / AT_EVERY) - 1; // 最后一组可能仍在进行
+    bool ok = frame_drop == 0 && frame_order_err == 0 && frames_rx + 1 >= frames_tx && lat_max <= 1
+              && at_order_err == 0 && at_batches_done >= expect_batches && at_batches_done > 0
+              && log_drop > 0 && logs_out > 0;
+
+    printf("frames : tx=%lu rx=%lu drop=%lu order_err=%lu, ingest->control latency max=%lu tick\n",
+           (unsigned long)frames_tx, (unsigned long)frames_rx, (unsigned long)frame_drop,
+           (unsigned long)frame_order_err, (unsigned long)lat_max);
+    printf("at     : cmds tx=%lu done=%lu, batches=%lu, order_err=%lu\n", (unsigned long)at_cmds_tx,
+           (unsigned long)at_cmds_done, (unsigned long)at_batches_done, (unsigned long)at_order_err);
+    printf("log    : out=%lu dropped=%lu (queue %d)\n", (unsigned long)logs_out, (unsigned long)log_drop,
+           LOG_QUEUE_LEN);
+    printf("host   : heap min free %lu / %lu, stack free words control=%lu ingest=%lu config=%lu telemetry=%lu\n",
+           (unsigned long)xPortGetMinimumEverFreeHeapSize(), (unsigned long)configTOTAL_HEAP_SIZE,
+           (unsigned long)uxTaskGetStackHighWaterMark(control_h), (unsigned long)uxTaskGetStackHighWaterMark(ingest_h),
+           (unsigned long)uxTaskGetStackHighWaterMark(config_h), (unsigned long)uxTaskGetStackHighWaterMark(telemetry_h));
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    fflush(stdout);
+    exit(ok ? 0 : 1);
+}
+
+void vApplicationMallocFailedHook(void) {
+    printf("FAIL: heap exhausted\n");
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) run_s = (uint32_t)strtoul(argv[1], NULL, 10);
+    if (run_s < 3) run_s = 3;
+
+    log_queue = xQueueCreate(LOG_QUEUE_LEN, sizeof(LogLine));
+    frame_queue = xQueueCreate(FRAME_QUEUE_LEN, sizeof(FrameMsg));
+    at_cmd_queue = xQueueCreate(AT_QUEUE_MAX, sizeof(AtCmd));
+    if (!log_queue || !frame_queue || !at_cmd_queue) return 1;
+
+    if (xTaskCreate(task_control, "control", RTOS_STACK_CONTROL * STACK_SCALE, NULL, RTOS_PRIO_CONTROL, &control_h) != pdPASS ||
+        xTaskCreate(task_ingest, "ingest", RTOS_STACK_INGEST * STACK_SCALE, NULL, RTOS_PRIO_INGEST, &ingest_h) != pdPASS ||
+        xTaskCreate(task_config, "config", RTOS_STACK_CONFIG * STACK_SCALE, NULL, RTOS_PRIO_CONFIG, &config_h) != pdPASS ||
+        xTaskCreate(task_telemetry, "telem", RTOS_STACK_TELEMETRY * STACK_SCALE, NULL, RTOS_PRIO_TELEMETRY, &telemetry_h) != pdPASS ||
+        xTaskCreate(task_monitor, "monitor", configMINIMAL_STACK_SIZE, NULL, RTOS_PRIO_CONTROL, NULL) != pdPASS) {
+        return 1;
+    }
+    printf("rtos_smoke: %lu s, frame %d ms, prio control=%d ingest=%d config=%d telemetry=%d\n",
+           (unsigned long)run_s, FRAME_MS, RTOS_PRIO_CONTROL, RTOS_PRIO_INGEST, RTOS_PRIO_CONFIG, RTOS_PRIO_TELEMETRY);
+    vTaskStartScheduler();
+    return 1;
+}
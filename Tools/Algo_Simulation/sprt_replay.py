@@ -0,0 +1,185 @@
+"""
+DETECT 放杯判定规则离线回放对比
+
+对录制的传感器原始输出（每行 "a:..,b:..,s:..."，可带毫秒时间戳前缀）
+分别回放以下规则，统计误触发率与平均判定时间：
+  legacy : 16点均值 < 250，连续15帧（旧固件）
+  hold   : 16点均值 < 250，持续1400ms且至少5帧（debounce.c）
+  sprt   : 原始 a/b 的序贯概率比检验（cup_sprt.c，定点实现逐位一致）
+
+用法：
+  python sprt_replay.py --empty empty_*.log --cup cup_*.log [--frame-ms 100]
+
+空腔会话（--empty）中任何一次判定都算误触发；
+有杯会话（--cup）中，以 "#cup" 注释行标记放杯时刻（没有则取首帧），
+统计从放杯到判定的时间，以及未判定（漏检）的会话数。
+"""
+import argparse
+import re
+
+# ---- 与 main.c / cup_sprt.h 保持一致 ----
+THRESH_DETECT_STOP = 250
+MA_WINDOW = 16
+LEGACY_FRAMES = 15
+DETECT_HOLD_MS = 1400
+DETECT_MIN_FRAMES = 5
+
+SPRT_Q = 256
+SPRT_MU_EMPTY = 320
+SPRT_MU_CUP = 200
+SPRT_SIGMA = 30
+SPRT_B_WEAK = 200
+SPRT_LLR_CLIP = 384
+SPRT_UPPER = 1166
+SPRT_LOWER = -765
+
+FRAME_RE = re.compile(r'a:(-?\d+),\s*b:(-?\d+)')
+TS_RE = re.compile(r'^\s*\[?(\d+(?:\.\d+)?)\]?\s')
+
+
+def c_div(a, b):
+    """C 语言整数除法（向零取整）"""
+    q = abs(a) // abs(b)
+    return q if (a >= 0) == (b >= 0) else -q
+
+
+def load_session(path, frame_ms):
+    """返回 (frames, cup_index)；frames 为 [(t_ms, a, b)]"""
+    frames = []
+    cup_index = None
+    t = 0.0
+    with open(path, encoding='utf-8', errors='ignore') as f:
+        for line in f:
+            if line.strip().startswith('#cup'):
+                cup_index = len(frames)
+                continue
+            m = FRAME_RE.search(line)
+            if not m:
+                continue
+            ts = TS_RE.match(line)
+            if ts:
+                t = float(ts.group(1))
+            else:
+                t = len(frames) * frame_ms
+            frames.append((t, int(m.group(1)), int(m.group(2))))
+    return frames, (cup_index or 0)
+
+
+class MovingAverage:
+    def __init__(self, window):
+        self.window = window
+        self.hist = []
+
+    def update(self, a):
+        self.hist.append(a)
+        if len(self.hist) > self.window:
+            self.hist.pop(0)
+        return c_div(sum(self.hist), len(self.hist))
+
+
+class LegacyRule:
+    name = 'legacy'
+
+    def __init__(self):
+        self.ma = MovingAverage(MA_WINDOW)
+        self.count = 0
+
+    def update(self, t, a, b):
+        af = self.ma.update(a)
+        self.count = self.count + 1 if af < THRESH_DETECT_STOP else 0
+        return self.count >= LEGACY_FRAMES
+
+
+class HoldRule:
+    name = 'hold'
+
+    def __init__(self):
+        self.ma = MovingAverage(MA_WINDOW)
+        self.frames = 0
+        self.since = None
+
+    def update(self, t, a, b):
+        af = self.ma.update(a)
+        if af >= THRESH_DETECT_STOP:
+            self.frames = 0
+            self.since = None
+            return False
+        if self.since is None:
+            self.since = t
+        self.frames += 1
+        return self.frames >= DETECT_MIN_FRAMES and (t - self.since) >= DETECT_HOLD_MS
+
+
+def sprt_frame_llr(a, b):
+    if a <= 0:
+        return 0
+    mid = (SPRT_MU_EMPTY + SPRT_MU_CUP) // 2
+    llr = c_div((SPRT_MU_EMPTY - SPRT_MU_CUP) * SPRT_Q * (mid - a), SPRT_SIGMA * SPRT_SIGMA)
+    if b < SPRT_B_WEAK:
+        llr = c_div(llr, 2)
+    return max(-SPRT_LLR_CLIP, min(SPRT_LLR_CLIP, llr))
+
+
+class SprtRule:
+    name = 'sprt'
+
+    def __init__(self):
+        self.llr = 0
+
+    def update(self, t, a, b):
+        self.llr += sprt_frame_llr(a, b)
+        if self.llr >= SPRT_UPPER:
+            return True
+        if self.llr <= SPRT_LOWER:
+            self.llr = 0
+        return False
+
+
+RULES = [LegacyRule, HoldRule, SprtRule]
+
+
+def replay(rule_cls, frames, start=0):
+    """返回所有判定时刻（判定后规则重新开始，模拟回到 DETECT）"""
+    rule = rule_cls()
+    hits = []
+    for t, a, b in frames[start:]:
+        if rule.update(t, a, b):
+            hits.append(t)
+            rule = rule_cls()
+    return hits
+
+
+def main():
+    ap = argparse.ArgumentParser(description='DETECT rule replay: false triggers and decision time')
+    ap.add_argument('--empty', nargs='*', default=[], help='空腔会话录制文件')
+    ap.add_argument('--cup', nargs='*', default=[], help='有杯会话录制文件（#cup 标记放杯）')
+    ap.add_argument('--frame-ms', type=float, default=100.0, help='无时间戳时的帧间隔')
+    args = ap.parse_args()
+
+    empty = [load_session(p, args.frame_ms) for p in args.empty]
+    cups = [(p, load_session(p, args.frame_ms)) for p in args.cup]
+
+    empty_hours = sum((f[-1][0] - f[0][0]) for f, _ in empty if f) / 3600000.0
+
+    print(f"{'rule':<8} {'false/h':>8} {'false':>6} {'mean_ms':>8} {'max_ms':>8} {'miss':>5}")
+    for rule_cls in RULES:
+        false_hits = sum(len(replay(rule_cls, f)) for f, _ in empty)
+        delays = []
+        misses = 0
+        for _, (frames, cup_idx) in cups:
+            if cup_idx >= len(frames):
+                misses += 1
+                continue
+            hits = replay(rule_cls, frames, cup_idx)
+            if hits:
+                delays.append(hits[0] - frames[cup_idx][0])
+            else:
+                misses += 1
+        rate = (false_hits / empty_hours) if empty_hours > 0 else float('nan')
+        mean = (sum(delays) / len(delays)) if delays else float('nan')
+        worst = max(delays) if delays else float('nan')
+        print(f"{rule_cls.name:<8} {rate:>8.2f} {false_hits:>6} {mean:>8.0f} {worst:>8.0f} {misses:>5}")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,109 @@
+/*
+ * spsc_queue.c 的主机多线程压力测试
+ * 生产者线程模拟中断，按序号连续写入事件。队列满时通常让出 CPU 等消费者取走（中断的到达间隔
+ * 远大于主循环一轮，正常情况下不应丢事件）；约 1/256 的事件不等待直接写入，模拟突发，
+ * 队列满则丢弃并记数，与固件行为一致。
+ * 消费者线程模拟主循环，检查：
+ *  - 取到的序号严格递增（不重复、不乱序）
+ *  - 事件内容与序号匹配（发布顺序正确，没有读到写了一半的槽位）
+ *  - 收到数 + 丢弃数 == 写入总数，且 overflow 计数与生产者看到的失败次数一致
+ *  - 只有突发写入可能被丢弃，至少 99% 的事件送达
+ *
+ * 编译运行（在本目录下）：
+ *   gcc -O2 -pthread -I../../water_dispenser3/Core/Inc spsc_stress.c ../../water_dispenser3/Core/Src/spsc_queue.c -o spsc_stress
+ *   ./spsc_stress [事件数，默认 2000000]
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "spsc_queue.h"
+
+static SpscQueue_t q;
+static uint32_t total = 2000000u;
+static uint32_t dropped = 0;
+static uint32_t bursts = 0;     // 不等待直接写入的事件数
+static volatile int producer_done = 0;
+
+// 由序号生成类型，消费者据此校验槽位内容
+static uint8_t type_of(uint32_t seq) {
+    return (uint8_t)(SPSC_EV_FRAME_READY + (seq % 4u));
+}
+
+static uint32_t xorshift(uint32_t *s) {
+    *s ^= *s << 13;
+    *s ^= *s >> 17;
+    *s ^= *s << 5;
+    return *s;
+}
+
+static void *producer(void *arg) {
+    (void)arg;
+    uint32_t rnd = 0x12345678u;
+    for (uint32_t seq = 1; seq <= total; seq++) {
+        SpscEvent_t e = { type_of(seq), seq };
+        uint32_t r = xorshift(&rnd);
+        if ((r & 0xFF00u) == 0) {
+            bursts++;
+        } else {
+            // 生产者侧读 tail 只为节流，不影响队列本身的正确性
+            while (q.head - __atomic_load_n(&q.tail, __ATOMIC_ACQUIRE) >= SPSC_CAPACITY)
+                sched_yield();
+        }
+        if (!spsc_push(&q, &e)) dropped++;
+        if ((r & 0xFFu) == 0) sched_yield(); // 打乱两边的交错
+    }
+    __atomic_store_n(&producer_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void *consumer(void *arg) {
+    uint32_t *received = (uint32_t *)arg;
+    uint32_t last = 0;
+    uint32_t rnd = 0x9E3779B9u;
+    SpscEvent_t e;
+    for (;;) {
+        if (spsc_pop(&q, &e)) {
+            if (e.arg <= last || e.type != type_of(e.arg)) {
+                fprintf(stderr, "FAIL: got seq=%u type=%u after seq=%u\n",
+                        (unsigned)e.arg, (unsigned)e.type, (unsigned)last);
+                exit(1);
+            }
+            last = e.arg;
+            (*received)++;
+            if ((xorshift(&rnd) & 0x3FFu) == 0) sched_yield();
+        } else if (__atomic_load_n(&producer_done, __ATOMIC_ACQUIRE) && spsc_empty(&q)) {
+            break;
+        } else {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) total = (uint32_t)strtoul(argv[1], NULL, 0);
+    spsc_init(&q);
+
+    uint32_t received = 0;
+    pthread_t tp, tc;
+    pthread_create(&tc, NULL, consumer, &received);
+    pthread_create(&tp, NULL, producer, NULL);
+    pthread_join(tp, NULL);
+    pthread_join(tc, NULL);
+
+    printf("events=%u received=%u dropped=%u bursts=%u overflow=%u high_water=%u\n",
+           (unsigned)total, (unsigned)received, (unsigned)dropped, (unsigned)bursts,
+           (unsigned)q.overflow, (unsigned)q.high_water);
+    if (received + dropped != total || q.overflow != dropped || q.high_water > SPSC_CAPACITY) {
+        fprintf(stderr, "FAIL: counts do not add up\n");
+        return 1;
+    }
+    if (dropped > bursts || (uint64_t)received * 100u < (uint64_t)total * 99u) {
+        fprintf(stderr, "FAIL: delivered %u of %u events (bursts %u)\n",
+                (unsigned)received, (unsigned)total, (unsigned)bursts);
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
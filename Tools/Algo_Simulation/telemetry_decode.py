@@ -0,0 +1,325 @@
+"""
+USART2 二进制遥测解码（固件 telemetry.c，USE_BINARY_TELEMETRY=1）
+
+线上格式：每帧 COBS 编码，以 0x00 分隔；解码后为
+  [type][seq][t_ms u32][payload][crc8]   多字节字段小端，CRC-8 多项式 0x07
+seq 逐帧 +1（8 位回绕），不连续即计为丢帧。
+
+用法：
+  python telemetry_decode.py --port COM5                   # 实时解码并打印
+  python telemetry_decode.py --port COM5 --raw cap.bin     # 同时保存原始字节
+  python telemetry_decode.py cap.bin --csv out/            # 每种记录一个 CSV
+  python telemetry_decode.py cap.bin --json                # JSON lines
+  python telemetry_decode.py cap.bin --text-only > dump.log   # 仅文本（可交给 blackbox_decode.py）
+  python telemetry_decode.py --port COM5 --elf water_dispenser3.elf  # 还原延迟格式化日志
+
+USE_DEFERRED_LOG=1 时 DEBUG_PRINT 只发送格式串编号和参数（TLM_T_LOG），格式串保存在 ELF 的
+.log_fmt 段中，需要用 --elf 指定与固件同一次编译产生的 ELF 文件才能还原文本。
+"""
+import argparse
+import csv
+import json
+import os
+import re
+import struct
+import sys
+
+# ---- 与 telemetry.h / main.c 保持一致 ----
+STATES = ['DETECT', 'CONFIGURE', 'VERIFY', 'MEASURE', 'WAIT', 'ABORT']
+METRICS = {1: 'time_to_first_water', 2: 'stop_error', 3: 'armed_at', 4: 'boot_to_first_frame'}
+VERIFY_PATHS = {0: 'full', 1: 'fast', 2: 'spec'}
+BOOT_KINDS = {0: 'cold', 1: 'warm', 2: 'warm-skip'}
+
+RECORDS = {
+    2: ('frame', '<hhhhhB', ['a', 'b', 'a_filtered', 'rate', 'innov', 'state']),
+    3: ('state', '<BBI', ['prev', 'next', 'dwell_ms']),
+    4: ('thresh', '<12h7B', ['edge_idx', 'liquid_idx', 'x', 't1', 'y', 't2', 'sep', 't1_headroom',
+                             'edge_distance', 'cup_depth', 'alarm_distance', 'stop_distance',
+                             'peak_count', 'edge_extension', 'edge_prom_pct', 'liquid_prom_pct',
+                             'confidence', 'strong_echo', 'cache_hit']),
+    5: ('metric', '<Bii', ['id', 'value', 'aux']),
+}
+TEXT = 1
+LOG = 6
+
+# printf 转换说明（deferred_log.c：%s 为 [长度][字节]，其余为 4 字节字）
+SPEC_RE = re.compile(r'%([-+ #0]*\d*(?:\.\d+)?)(?:hh|h|ll|l|z)?([diouxXcsp%])')
+
+
+def crc8(data):
+    crc = 0
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            raise ValueError('bad COBS')
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+class LogFormats:
+    """.log_fmt 段内容：编号即格式串地址"""
+
+    def __init__(self, base, data):
+        self.base = base
+        self.data = data
+
+    def get(self, log_id):
+        off = log_id - self.base
+        if not 0 <= off < len(self.data):
+            return None
+        end = self.data.find(b'\0', off)
+        return self.data[off:end if end >= 0 else len(self.data)].decode('utf-8', errors='replace')
+
+
+def load_log_formats(path):
+    """从 ELF32 读取 .log_fmt 段"""
+    with open(path, 'rb') as f:
+        elf = f.read()
+    if elf[:4] != b'\x7fELF' or elf[4] != 1:
+        raise ValueError(f'{path}: not an ELF32 file')
+    shoff, = struct.unpack_from('<I', elf, 0x20)
+    shentsize, shnum, shstrndx = struct.unpack_from('<HHH', elf, 0x2E)
+    sections = [struct.unpack_from('<10I', elf, shoff + i * shentsize) for i in range(shnum)]
+    names_off = sections[shstrndx][4]
+    for sec in sections:
+        name_at = names_off + sec[0]
+        if elf[name_at:elf.index(b'\0', name_at)] == b'.log_fmt':
+            addr, off, size = sec[3], sec[4], sec[5]
+            return LogFormats(addr, elf[off:off + size])
+    raise ValueError(f'{path}: no .log_fmt section (firmware built with USE_DEFERRED_LOG=0?)')
+
+
+def render_log(fmt, payload):
+    """按格式串取出参数并格式化；载荷被截断时缺少的参数显示为 <?>"""
+    pos = 2
+
+    def conv(m):
+        nonlocal pos
+        flags, c = m.group(1), m.group(2)
+        if c == '%':
+            return '%'
+        if c == 's':
+            if pos >= len(payload):
+                return '<?>'
+            n = payload[pos]
+            val = payload[pos + 1:pos + 1 + n].decode('utf-8', errors='replace')
+            pos += 1 + n
+            return ('%' + flags + 's') % val
+        if pos + 4 > len(payload):
+            return '<?>'
+        w, = struct.unpack_from('<I', payload, pos)
+        pos += 4
+        if c in 'di' and w & 0x80000000:
+            w -= 1 << 32
+        if c == 'p':
+            return f'0x{w:08x}'
+        if c == 'c':
+            return chr(w & 0xFF)
+        return ('%' + flags + ('d' if c in 'diu' else c)) % w
+
+    return SPEC_RE.sub(conv, fmt)
+
+
+def state_name(i):
+    return STATES[i] if 0 <= i < len(STATES) else str(i)
+
+
+class Decoder:
+    def __init__(self, formats=None):
+        self.formats = formats
+        self.buf = bytearray()
+        self.last_seq = None
+        self.packets = 0
+        self.dropped = 0
+        self.bad = 0
+        self.text = bytearray()
+
+    def feed(self, data):
+        """输入原始字节，产生 (type, seq, t_ms, fields|text) 记录"""
+        self.buf += data
+        while True:
+            end = self.buf.find(0)
+            if end < 0:
+                return
+            chunk = bytes(self.buf[:end])
+            del self.buf[:end + 1]
+            if not chunk:
+                continue
+            try:
+                raw = cobs_decode(chunk)
+            except ValueError:
+                self.bad += 1
+                continue
+            if len(raw) < 7 or crc8(raw[:-1]) != raw[-1]:
+                self.bad += 1
+                continue
+            typ, seq, t_ms = struct.unpack_from('<BBI', raw)
+            payload = raw[6:-1]
+            if self.last_seq is not None:
+                self.dropped += (seq - self.last_seq - 1) & 0xFF
+            self.last_seq = seq
+            self.packets += 1
+            rec = self.parse(typ, payload)
+            if rec is None:
+                self.bad += 1
+                continue
+            yield typ, seq, t_ms, rec
+
+    def parse(self, typ, payload):
+        if typ == TEXT:
+            return payload.decode('utf-8', errors='replace')
+        if typ == LOG:
+            if len(payload) < 2:
+                return None
+            log_id = payload[0] | (payload[1] << 8)
+            fmt = self.formats.get(log_id) if self.formats else None
+            if fmt is None:
+                return f'<log #{log_id}: {payload[2:].hex()}>\r\n'
+            return render_log(fmt, payload)
+        if typ not in RECORDS:
+            return None
+        name, fmt, fields = RECORDS[typ]
+        if len(payload) != struct.calcsize(fmt):
+            return None
+        return dict(zip(fields, struct.unpack(fmt, payload)))
+
+
+def describe(typ, rec):
+    if typ == 2:
+        b = '-' if rec['b'] < 0 else rec['b']
+        return (f"a={rec['a']} b={b} a_f={rec['a_filtered']} rate={rec['rate']} "
+                f"innov={rec['innov']} [{state_name(rec['state'])}]")
+    if typ == 3:
+        return f"{state_name(rec['prev'])} -> {state_name(rec['next'])} dwell={rec['dwell_ms']} ms"
+    if typ == 4:
+        return (f"edge={rec['edge_idx']} liquid={rec['liquid_idx']} x={rec['x']} t1={rec['t1']} "
+                f"y={rec['y']} t2={rec['t2']} conf={rec['confidence']} edge_d={rec['edge_distance']} "
+                f"depth={rec['cup_depth']} alarm={rec['alarm_distance']} stop={rec['stop_distance']} "
+                f"strong={rec['strong_echo']} cache={rec['cache_hit']}")
+    if typ == 5:
+        name = METRICS.get(rec['id'], f"metric{rec['id']}")
+        if rec['id'] == 1:
+            return f"{name}={rec['value']} ms ({VERIFY_PATHS.get(rec['aux'], rec['aux'])})"
+        if rec['id'] == 4:
+            return f"{name}={rec['value']} ms ({BOOT_KINDS.get(rec['aux'], rec['aux'])})"
+        return f"{name}={rec['value']} aux={rec['aux']}"
+    return str(rec)
+
+
+class CsvSink:
+    def __init__(self, outdir):
+        os.makedirs(outdir, exist_ok=True)
+        self.outdir = outdir
+        self.files = {}
+
+    def write(self, typ, seq, t_ms, rec):
+        if typ not in self.files:
+            name, _, fields = RECORDS[typ]
+            f = open(os.path.join(self.outdir, f'{name}.csv'), 'w', newline='', encoding='utf-8')
+            w = csv.writer(f)
+            w.writerow(['seq', 't_ms'] + fields)
+            self.files[typ] = (f, w, fields)
+        f, w, fields = self.files[typ]
+        w.writerow([seq, t_ms] + [rec[k] for k in fields])
+        f.flush()  # 实时查看
+
+    def close(self):
+        for f, _, _ in self.files.values():
+            f.close()
+
+
+def source(args):
+    if args.port:
+        import serial  # pyserial
+        ser = serial.Serial(args.port, args.baud, timeout=0.1)
+        raw = open(args.raw, 'wb') if args.raw else None
+        try:
+            while True:
+                data = ser.read(256)
+                if data:
+                    if raw:
+                        raw.write(data)
+                        raw.flush()
+                    yield data
+        finally:
+            ser.close()
+            if raw:
+                raw.close()
+    else:
+        with open(args.capture, 'rb') as f:
+            while True:
+                data = f.read(4096)
+                if not data:
+                    return
+                yield data
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Decode COBS-framed binary telemetry from the dispenser firmware')
+    ap.add_argument('capture', nargs='?', help='原始字节抓包文件（省略时使用 --port）')
+    ap.add_argument('--port', help='串口（实时解码）')
+    ap.add_argument('--baud', type=int, default=115200)
+    ap.add_argument('--raw', help='串口模式下同时保存原始字节')
+    ap.add_argument('--json', action='store_true', help='输出 JSON lines')
+    ap.add_argument('--csv', metavar='DIR', help='每种记录写一个 CSV（frame/state/thresh/metric）')
+    ap.add_argument('--text-only', action='store_true', help='只输出文本记录（原样）')
+    ap.add_argument('--elf', help='固件 ELF（还原 TLM_T_LOG 延迟格式化日志）')
+    args = ap.parse_args()
+    if not args.port and not args.capture:
+        ap.error('需要抓包文件或 --port')
+
+    try:
+        dec = Decoder(load_log_formats(args.elf) if args.elf else None)
+    except (OSError, ValueError) as e:
+        ap.error(str(e))
+    sink = CsvSink(args.csv) if args.csv else None
+    try:
+        for data in source(args):
+            for typ, seq, t_ms, rec in dec.feed(data):
+                if typ in (TEXT, LOG):
+                    if args.text_only:
+                        sys.stdout.write(rec)
+                    elif args.json:
+                        kind = 'text' if typ == TEXT else 'log'
+                        print(json.dumps({'seq': seq, 't_ms': t_ms, 'type': kind, 'text': rec}))
+                    else:
+                        # 文本可能被分段：拼接到换行再打印
+                        dec.text += rec.encode('utf-8')
+                        while b'\n' in dec.text:
+                            line, _, rest = dec.text.partition(b'\n')
+                            dec.text = bytearray(rest)
+                            print(f"{t_ms:>10} ms  {'TEXT' if typ == TEXT else 'LOG':<7} {line.decode('utf-8', 'replace').rstrip()}")
+                    continue
+                if sink:
+                    sink.write(typ, seq, t_ms, rec)
+                if args.text_only:
+                    continue
+                if args.json:
+                    print(json.dumps(dict(seq=seq, t_ms=t_ms, type=RECORDS[typ][0], **rec)))
+                else:
+                    print(f'{t_ms:>10} ms  {RECORDS[typ][0].upper():<7} {describe(typ, rec)}')
+                sys.stdout.flush()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if sink:
+            sink.close()
+    print(f'packets={dec.packets} dropped={dec.dropped} bad={dec.bad}', file=sys.stderr)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,60 @@
+#ifndef APP_RTOS_H
+#define APP_RTOS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 可选的 FreeRTOS 构建（默认关闭，仍使用主循环 + 协作式调度）
+ *
+ * 启用步骤：
+ *  1. CubeMX 中启用 FREERTOS 中间件（原生 API，heap_4，configTOTAL_HEAP_SIZE 取 9.5KB（9728），见下方 RAM 预算，
+ *     configUSE_TIMERS=0，configMAX_PRIORITIES=5，configCHECK_FOR_STACK_OVERFLOW=2，
+ *     configUSE_MALLOC_FAILED_HOOK=1，INCLUDE_uxTaskGetStackHighWaterMark=1），HAL 时基改用 TIM4
+ *  2. USART1、DMA1_Channel5 中断抢占优先级设为 >= configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY（通常为5），
+ *     因为空闲中断中的快速停泵会调用 FromISR 接口
+ *  3. 将 USE_FREERTOS 改为 1
+ *
+ * 任务与优先级（数值越大越优先），任务之间只经队列/通知交换数据，没有共享锁：
+ *  control   - 帧处理、调度超时/状态机/水泵控制；从 frame_queue 取帧，向 at_cmd_queue 投递 AT 命令
+ *  ingest    - DMA 数据与帧解析，结果送入 frame_queue；AT 序列进行中丢弃收到的数据
+ *  config    - 从 at_cmd_queue 取命令，发送并等待 OK（阻塞的串口收发只在本任务中）
+ *  telemetry - USART2 日志输出，栈/堆水位报告
+ *
+ * RAM 预算（Tools/Algo_Simulation/ram_budget.py，按编译器输出统计，未计 C 库与内核自身的静态区）：
+ *  静态区 8476B（.data 199 + .bss 8277，USE_FREERTOS=1）+ 堆 9728B + 链接脚本保留 1536B = 19740B / 20480B
+ *  最坏栈深（调用图 + -fstack-usage，i386 帧，不含 vsnprintf 等库函数；任务栈另加 64B 上下文）：
+ *    control 2312B（removal_check -> configure_entry -> compute_thresholds），ingest 192B，config 928B，telemetry 864B，
+ *    中断 296B（MSP）；启动阶段 main 1264B 也在 MSP 上，超出保留的 1KB 部分落在未用的 RAM 中
+ *  堆（heap_4，每块 +8B 对齐到 8）：任务栈 5536B + 空闲任务栈 520B + 5 个 TCB 约 520B
+ *    + log_queue 1256B + frame_queue 1024B + at_cmd_queue 296B ≈ 9.0KB
+ *  上板后以 [RTOS] 报告的 stack free / heap min 为准
+ */
+#define USE_FREERTOS            0
+
+#define RTOS_PRIO_CONTROL       4
+#define RTOS_PRIO_INGEST        3
+#define RTOS_PRIO_CONFIG        2
+#define RTOS_PRIO_TELEMETRY     1
+
+// 栈大小（字），按上面的最坏栈深留余量。control 的最深路径是 compute_thresholds（约 1.2KB 局部数组）
+#define RTOS_STACK_CONTROL      640
+#define RTOS_STACK_INGEST       128
+#define RTOS_STACK_CONFIG       320     // send_at 的 vsnprintf
+#define RTOS_STACK_TELEMETRY    288
+
+// 日志队列：12 x 97 字节，约 1.2KB
+#define LOG_QUEUE_LEN           12
+#define LOG_LINE_LEN            96
+
+// 帧队列：每条含 224 点 int16 波形（468 字节），control 每帧都会及时取走
+#define FRAME_QUEUE_LEN         2
+
+#define RTOS_REPORT_MS          30000   // 栈/堆水位报告周期
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // APP_RTOS_H
@@ -0,0 +1,90 @@
+#ifndef BLACKBOX_H
+#define BLACKBOX_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 黑匣子：RAM 中的定长事件环形缓冲，故障/复位前整体写入保留的 Flash 区域
+ * - 每条记录 12 字节：时间戳 + 类型 + 1 个小参数 + 3 个 16 位值（超出范围时饱和）
+ * - 记录开销为一次关中断下的结构体写入，可在中断中调用，生产版本保持开启
+ * - Flash 中只保留最近一次转储；下次上电后可通过 USART2 整体导出（十六进制行）
+ * - 转储会擦除两页，只在有必要时进行：缓冲中只有启动/看门狗记录时不写；上一次转储
+ *   尚未导出时不覆盖（HardFault 可替换一次非 HardFault 的转储）；两次导出之间最多
+ *   BB_FLUSH_MAX 次（计数在 BKP，掉电清零）。无解析复位循环因此不会反复擦写
+ * - 擦写直接操作 FPEC 寄存器，不依赖 HAL 状态，HardFault 中可用
+ */
+#define BB_FLASH_ADDR    0x0800F000U   // 与链接脚本 BLACKBOX 区域一致（两页）
+#define BB_FLASH_SIZE    2048U
+#define BB_RING_LEN      64            // 2 的幂
+#define BB_MAGIC         0x31584242U   // "BBX1"
+#define BB_FLUSH_MAX     2             // 两次导出之间最多转储次数（一次普通 + 一次 HardFault）
+#define BB_NOT_EXPORTED  0xFFFFU       // BbHeader_t.exported：尚未通过 USART2 导出
+
+// 事件类型（上位机 blackbox_decode.py 中保持一致）
+typedef enum {
+    BB_EV_BOOT = 1,      // arg=启动类型(0冷/1热/2热且跳过初始化)，v0=RCC_CSR 高16位
+    BB_EV_STATE,         // arg=新状态，v0=旧状态，v1=旧状态停留时间(ms)
+    BB_EV_AT,            // arg=0 序列完成/1 单条超时，v0=命令数或序号，v1=失败数
+    BB_EV_WDOG,          // arg=1 整机复位/0 传感器恢复，v0=无解析时间(100ms)
+    BB_EV_VERIFY,        // arg=重配次数，v0=新 t1，v1=失败样本 b 最大值
+    BB_EV_STOP,          // arg=0 主循环/1 中断，v0=a_filtered，v1=stop_distance，v2=提前量
+    BB_EV_REMOVAL,       // arg=原因(1 距离/2 回波丢失)，v0=a，v1=b，v2=出水时间(100ms)
+    BB_EV_FLUSH          // arg=转储原因（每次转储写入的最后一条）
+} BbEvent_e;
+
+// 转储原因
+typedef enum {
+    BB_FLUSH_RESET = 1,  // 主动复位前
+    BB_FLUSH_FAULT,      // HardFault
+    BB_FLUSH_WDOG        // 看门狗软恢复
+} BbFlush_e;
+
+typedef struct {
+    uint32_t t_ms;
+    uint8_t  type;
+    uint8_t  arg;
+    int16_t  v[3];
+} BbRecord_t;
+
+// Flash 中转储的头部，之后紧跟 count 条记录（按时间先后）
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;        // 转储序号（逐次 +1）
+    uint32_t t_ms;       // 转储时刻
+    uint16_t count;
+    uint8_t  reason;
+    uint8_t  reserved;
+    uint16_t crc;        // 记录区 CRC-16/CCITT
+    uint16_t exported;   // BB_NOT_EXPORTED=未导出，0=已导出（导出后原位写入）
+} BbHeader_t;
+
+void bb_log(uint8_t type, uint8_t arg, int32_t v0, int32_t v1, int32_t v2);
+
+/**
+ * 把 RAM 环形缓冲写入 Flash（擦除两页约 40ms，只在故障/复位路径调用），按上面的策略可能跳过
+ * @return 1=已写入，0=跳过或失败
+ */
+uint8_t bb_flush(uint8_t reason);
+
+/**
+ * 上一次转储（若有效）
+ * @return NULL=无有效转储
+ */
+const BbHeader_t *bb_saved(void);
+
+/**
+ * 导出：每条记录一行 "BB,<src>,<hex>"，src=F 为 Flash 转储、R 为当前 RAM 缓冲
+ * 头部一行 "BB,H,<src>,<hex 头部>"；导出后 Flash 转储标记为已导出，允许下一次转储覆盖
+ * @param write 输出函数（阻塞发送）
+ */
+void bb_dump(void (*write)(const uint8_t *data, uint16_t len));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BLACKBOX_H
@@ -0,0 +1,79 @@
+#ifndef CUP_CACHE_H
+#define CUP_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ultrasonic_threshold.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 杯子指纹缓存：同一只杯子反复出现时复用上次标定好的阈值
+ * 指纹取自 CONFIGURE 波形：边沿/液位峰位置、幅度与峰数量
+ * 表项按最近使用排序（LRU），表满时替换最久未用的一项
+ */
+#define CUP_CACHE_SIZE        8
+#define CUP_SIG_IDX_TOL       2    // 峰位置容差（点）
+#define CUP_SIG_AMP_TOL_PCT   20   // 峰幅度容差（%）
+#define CUP_SIG_PEAKS_TOL     1    // 峰数量容差
+
+// 波形指纹
+typedef struct {
+    int16_t edge_idx;
+    int16_t liquid_idx;
+    int16_t edge_amp;
+    int16_t liquid_amp;
+    uint8_t peak_count;
+} CupSig_t;
+
+// 缓存项：指纹 + 最终标定参数（含 VERIFY 调整后的 t1）
+// 只有 hits 之前的字段写入 Flash；hits/stamp 每次命中都变，只保存在 RAM 中，
+// 否则命中一次就要重写一条记录，键值存储的“值相同不写”也失效
+typedef struct {
+    CupSig_t sig;
+    int16_t  x;
+    int16_t  t1;
+    int16_t  y;
+    int16_t  t2;
+    int16_t  stop_distance;
+    uint8_t  edge_extension;
+    uint8_t  used;         // 1=有效
+    uint16_t hits;         // 命中次数
+    uint32_t stamp;        // 最近使用时刻（逻辑时钟）
+} CupCacheEntry_t;
+
+#define CUP_CACHE_REC_LEN     offsetof(CupCacheEntry_t, hits)   // 持久化部分的长度
+
+typedef struct {
+    CupCacheEntry_t entries[CUP_CACHE_SIZE];
+    uint32_t clock;
+    uint32_t lookups;
+    uint32_t hits;
+} CupCache_t;
+
+void cup_cache_init(CupCache_t *c);
+
+// 从阈值算法结果提取指纹（无边沿/液位峰时幅度为 0）
+void cup_sig_from_result(const ThresholdResult_t *r, CupSig_t *sig);
+
+/**
+ * 查找容差内最接近的表项，命中时更新其使用时刻
+ * @return 命中的表项，未命中返回 NULL
+ */
+CupCacheEntry_t *cup_cache_find(CupCache_t *c, const CupSig_t *sig);
+
+/**
+ * 记录一只杯子的最终参数：容差内已有表项则覆盖，否则占用空位或替换最久未用项
+ * @return 写入的表项
+ */
+CupCacheEntry_t *cup_cache_store(CupCache_t *c, const CupSig_t *sig,
+                                 int x, int t1, int y, int t2,
+                                 int stop_distance, uint8_t edge_extension);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CUP_CACHE_H
@@ -0,0 +1,53 @@
+#ifndef CUP_SPRT_H
+#define CUP_SPRT_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 杯子有/无的序贯概率比检验（SPRT）
+ * 两个假设下 a 近似为同方差高斯：空腔 H0~N(MU_EMPTY, σ²)，有杯 H1~N(MU_CUP, σ²)
+ * 单帧对数似然比 = (MU_EMPTY - MU_CUP)/σ² * (mid - a)，mid 为两均值中点
+ * 累计值越过上界判“有杯”，越过下界判“空腔”并重新开始检验
+ * 所有对数似然比以 Q8 定点表示（256 = 1 nat）
+ */
+#define SPRT_Q            256
+#define SPRT_MU_EMPTY     320     // 空腔时 a 的典型值
+#define SPRT_MU_CUP       200     // 有杯时 a 的典型值
+#define SPRT_SIGMA        30
+#define SPRT_B_WEAK       200     // b 低于该值视为弱回波，证据减半
+#define SPRT_LLR_CLIP     384     // 单帧证据上限（约1.5 nat），单帧异常不足以判决
+#define SPRT_UPPER        1166    // ln((1-β)/α)，α=1%（误触发），β=5%（漏检）
+#define SPRT_LOWER        (-765)  // ln(β/(1-α))
+
+typedef enum {
+    SPRT_CONTINUE = 0,   // 证据不足，继续观察
+    SPRT_CUP,            // 判定有杯
+    SPRT_EMPTY           // 判定空腔（内部已重新开始）
+} SprtDecision;
+
+typedef struct {
+    int32_t  llr;        // 累计对数似然比（Q8）
+    uint16_t frames;     // 本次检验已用帧数
+} CupSprt_t;
+
+void cup_sprt_reset(CupSprt_t *s);
+
+// 单帧证据（Q8，已限幅），不改变检验状态
+int32_t cup_sprt_frame_llr(int a, int b);
+
+/**
+ * 输入一帧原始读数
+ * @param a 传感器距离读数（<=0 表示无回波，不计证据）
+ * @param b 回波强度
+ */
+SprtDecision cup_sprt_update(CupSprt_t *s, int a, int b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CUP_SPRT_H
@@ -0,0 +1,47 @@
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 按时间确认：条件需持续 hold_ms，且期间至少收到 min_frames 个新帧。
+ * 时间取自帧时间戳而非调用时刻，确认延迟与帧率无关；
+ * 帧序号用于忽略重复事件（同一帧不重复计数）。
+ */
+typedef struct {
+    uint32_t hold_ms;
+    uint8_t  min_frames;
+    uint8_t  frames;       // 条件成立以来的新帧数（含首帧）
+    uint8_t  holding;      // 条件当前是否成立
+    uint32_t since_ms;     // 条件首次成立的帧时间戳
+    uint32_t last_seq;     // 最近处理的帧序号
+    uint8_t  primed;       // 已处理过至少一帧（last_seq 有效）
+} Debounce_t;
+
+void debounce_init(Debounce_t *d, uint32_t hold_ms, uint8_t min_frames);
+void debounce_reset(Debounce_t *d);
+
+/**
+ * 每个新帧调用一次
+ * @param cond     本帧条件是否成立
+ * @param seq      帧序号（与上次相同则不计数，仅返回当前结果）
+ * @param frame_ms 帧时间戳
+ * @return 1=已确认（条件持续 >= hold_ms 且帧数 >= min_frames）
+ */
+uint8_t debounce_update(Debounce_t *d, uint8_t cond, uint32_t seq, uint32_t frame_ms);
+
+// 只读查询：当前是否已确认（不计数、不改变状态）
+uint8_t debounce_confirmed(const Debounce_t *d, uint32_t frame_ms);
+
+// 条件已持续的时间（不成立时为0）
+uint32_t debounce_held_ms(const Debounce_t *d, uint32_t frame_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DEBOUNCE_H
@@ -0,0 +1,85 @@
+#ifndef DEFERRED_LOG_H
+#define DEFERRED_LOG_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 延迟格式化日志：MCU 不做 printf 格式化，只发送格式串编号和原始参数
+ * - 格式串放在 .log_fmt 段（链接脚本中为 INFO 段，不占 Flash），编号即其在段内的偏移
+ * - 整型/指针参数各发 4 字节；char* 参数（%s）发 [长度][字节]，按剩余空间截断
+ * - 记录以 TLM_T_LOG 帧发送，上位机 telemetry_decode.py --elf 从 ELF 读回格式串还原文本
+ * 调用方式与 printf 相同，最多 DLOG_MAX_ARGS 个参数；不支持浮点（%f）
+ */
+#define DLOG_MAX_ARGS   12
+
+typedef struct {
+    uint32_t records;
+    uint32_t bytes;          // 有效载荷字节（编号 + 参数）
+    uint32_t enc_cyc;        // 编码耗时（DWT 周期，不含发送）
+} DlogStats_t;
+
+#define DLOG(fmt, ...) do { \
+        static const char dlog_fmt_[] __attribute__((section(".log_fmt"), used)) = fmt; \
+        dlog_write(dlog_fmt_, DLOG_STR_MASK(__VA_ARGS__), DLOG_NARGS(__VA_ARGS__), \
+                   (const uintptr_t[]){ DLOG_WORDS(__VA_ARGS__) 0 }); \
+    } while (0)
+
+/**
+ * 编码一条记录的有效载荷（不发送）；fmt 只取地址，不会被读取
+ * @param str_mask 第 i 位为 1 表示第 i 个参数是字符串指针
+ * @param out      至少 TLM_MAX_PAYLOAD 字节
+ * @return 载荷长度
+ */
+uint16_t dlog_encode(const char *fmt, uint16_t str_mask, uint8_t nargs, const uintptr_t *args, uint8_t *out);
+
+void dlog_write(const char *fmt, uint16_t str_mask, uint8_t nargs, const uintptr_t *args);
+
+const DlogStats_t *dlog_stats(void);
+
+/* ---- 参数展开（GNU ##__VA_ARGS__ 处理零参数） ---- */
+#define DLOG_NARGS(...)  DLOG_NARGS_(_, ##__VA_ARGS__, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define DLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, n, ...) n
+#define DLOG_CAT(a, b)   DLOG_CAT_(a, b)
+#define DLOG_CAT_(a, b)  a##b
+
+// _Generic 不求值，参数只在 DLOG_WORDS 中求值一次
+#define DLOG_IS_STR(x)   _Generic((x), char *: 1u, const char *: 1u, default: 0u)
+#define DLOG_STR_MASK(...) ((uint16_t)DLOG_CAT(DLOG_M_, DLOG_NARGS(__VA_ARGS__))(__VA_ARGS__))
+#define DLOG_M_0()         0u
+#define DLOG_M_1(x)        DLOG_IS_STR(x)
+#define DLOG_M_2(x, ...)   (DLOG_IS_STR(x) | (DLOG_M_1(__VA_ARGS__) << 1))
+#define DLOG_M_3(x, ...)   (DLOG_IS_STR(x) | (DLOG_M_2(__VA_ARGS__) << 1))
+#define DLOG_M_4(x, ...)   (DLOG_IS_STR(x) | (DLOG_M_3(__VA_ARGS__) << 1))
+#define DLOG_M_5(x, ...)   (DLOG_IS_STR(x) | (DLOG_M_4(__VA_ARGS__) << 1))
+#define DLOG_M_6(x, ...)   (DLOG_IS_STR(x) | (DLOG_M_5(__VA_ARGS__) << 1))
+#define DLOG_M_7(x, ...)   (DLOG_IS_STR(x) | (DLOG_M_6(__VA_ARGS__) << 1))
+#define DLOG_M_8(x, ...)   (DLOG_IS_STR(x) | (DLOG_M_7(__VA_ARGS__) << 1))
+#define DLOG_M_9(x, ...)   (DLOG_IS_STR(x) | (DLOG_M_8(__VA_ARGS__) << 1))
+#define DLOG_M_10(x, ...)  (DLOG_IS_STR(x) | (DLOG_M_9(__VA_ARGS__) << 1))
+#define DLOG_M_11(x, ...)  (DLOG_IS_STR(x) | (DLOG_M_10(__VA_ARGS__) << 1))
+#define DLOG_M_12(x, ...)  (DLOG_IS_STR(x) | (DLOG_M_11(__VA_ARGS__) << 1))
+
+#define DLOG_WORDS(...)    DLOG_CAT(DLOG_W_, DLOG_NARGS(__VA_ARGS__))(__VA_ARGS__)
+#define DLOG_W_0()
+#define DLOG_W_1(x)        (uintptr_t)(x),
+#define DLOG_W_2(x, ...)   (uintptr_t)(x), DLOG_W_1(__VA_ARGS__)
+#define DLOG_W_3(x, ...)   (uintptr_t)(x), DLOG_W_2(__VA_ARGS__)
+#define DLOG_W_4(x, ...)   (uintptr_t)(x), DLOG_W_3(__VA_ARGS__)
+#define DLOG_W_5(x, ...)   (uintptr_t)(x), DLOG_W_4(__VA_ARGS__)
+#define DLOG_W_6(x, ...)   (uintptr_t)(x), DLOG_W_5(__VA_ARGS__)
+#define DLOG_W_7(x, ...)   (uintptr_t)(x), DLOG_W_6(__VA_ARGS__)
+#define DLOG_W_8(x, ...)   (uintptr_t)(x), DLOG_W_7(__VA_ARGS__)
+#define DLOG_W_9(x, ...)   (uintptr_t)(x), DLOG_W_8(__VA_ARGS__)
+#define DLOG_W_10(x, ...)  (uintptr_t)(x), DLOG_W_9(__VA_ARGS__)
+#define DLOG_W_11(x, ...)  (uintptr_t)(x), DLOG_W_10(__VA_ARGS__)
+#define DLOG_W_12(x, ...)  (uintptr_t)(x), DLOG_W_11(__VA_ARGS__)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DEFERRED_LOG_H
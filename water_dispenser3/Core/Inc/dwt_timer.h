@@ -0,0 +1,30 @@
+#ifndef DWT_TIMER_H
+#define DWT_TIMER_H
+
+#include "main.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// DWT 周期计数器：用于微秒级延迟测量（72MHz 下约 59 秒回绕一次）
+static inline void dwt_init(void) {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static inline uint32_t dwt_cycles(void) {
+    return DWT->CYCCNT;
+}
+
+// 周期数换算为微秒
+static inline uint32_t dwt_cycles_to_us(uint32_t cycles) {
+    return cycles / (SystemCoreClock / 1000000U);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DWT_TIMER_H
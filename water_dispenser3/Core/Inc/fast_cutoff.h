@@ -0,0 +1,84 @@
+#ifndef FAST_CUTOFF_H
+#define FAST_CUTOFF_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// fast_cutoff_arm() 的 reject_max 取值：被剔除帧固定判为满足/不满足
+#define FAST_CUTOFF_ALWAYS  32767
+#define FAST_CUTOFF_NEVER   (-32768)
+
+// 快速停泵延迟统计（DWT 周期数）
+typedef struct {
+    uint32_t last;   // 最近一次：帧完成 -> PWM 关断
+    uint32_t min;
+    uint32_t max;
+    uint32_t count;
+    uint32_t rejected; // 被 Hampel 门限剔除的 a（以中位数代替）
+} FastCutoffStats_t;
+
+/**
+ * 初始化
+ * @param pump_off 关断水泵的函数，必须能在中断中以固定时间执行（直接写寄存器）
+ */
+void fast_cutoff_init(void (*pump_off)(void));
+
+/**
+ * 主循环在 MEASURE 降敏期结束后每帧调用，推送下一帧的停泵门限
+ * 门限由主循环的距离估计器（卡尔曼/均值）换算成原始 a 的上限，中断侧与主循环按同一判据停泵；
+ * 每次只对下一帧有效，主循环未及时更新时中断侧不判断（由主循环停泵）
+ * @param a_max          Hampel 接受的帧：a < a_max 满足距离条件
+ * @param reject_max     Hampel 剔除的帧：以中位数代替 a，中位数 < reject_max 满足（FAST_CUTOFF_ALWAYS/NEVER 固定结果）
+ * @param b_threshold    强回波阈值
+ * @param require_strong 1=同时要求 b > b_threshold
+ * @param confirm_max    连续满足的帧数
+ */
+void fast_cutoff_arm(int a_max, int reject_max, int b_threshold, uint8_t require_strong,
+                     uint8_t confirm_max);
+void fast_cutoff_disarm(void);
+
+// fast_cutoff_removed() 的返回值
+#define FAST_CUTOFF_REMOVED_FAR   1   // a 跳到杯底之外
+#define FAST_CUTOFF_REMOVED_LOST  2   // 回波丢失
+
+/**
+ * 主循环在进入 MEASURE 时调用：设置取杯保护（整个 MEASURE 有效，含降敏期）
+ * 按原始 a/b 判断，不经过 Hampel 门限与均值
+ * @param far_distance  a 大于该距离立即停泵（单帧）
+ * @param b_lost        b 小于该值视为回波丢失
+ * @param lost_frames   回波丢失需连续的帧数
+ */
+void fast_cutoff_guard(int far_distance, int b_lost, uint8_t lost_frames);
+
+/**
+ * 中断中调用：扫描 DMA 环形缓冲 [from, to) 的新字节，逐字节解析 a/b，遇到 "s:" 即视为一帧完成，
+ * 其后的波形数据不再扫描
+ */
+void fast_cutoff_feed(const uint8_t *ring, uint16_t ring_size, uint16_t from, uint16_t to);
+
+/**
+ * @return 1=中断侧已关断水泵（主循环据此完成后续状态切换与 AT 通信后调用 disarm 清除）
+ */
+uint8_t fast_cutoff_fired(void);
+
+/**
+ * @return 0=杯子仍在，否则为 FAST_CUTOFF_REMOVED_xxx（中断侧已关断水泵）
+ */
+uint8_t fast_cutoff_removed(void);
+
+/**
+ * 最近一帧完成时的 DWT 时间戳，用于测量主循环路径的停泵延迟
+ */
+uint32_t fast_cutoff_last_frame_cycles(void);
+
+const FastCutoffStats_t *fast_cutoff_stats(void);
+const FastCutoffStats_t *fast_cutoff_removal_stats(void); // 取杯停泵延迟
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FAST_CUTOFF_H
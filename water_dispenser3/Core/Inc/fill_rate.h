@@ -0,0 +1,42 @@
+#ifndef FILL_RATE_H
+#define FILL_RATE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 回归窗口长度（帧）
+#define FILL_RATE_WINDOW   8
+#define FILL_RATE_MIN_PTS  4     // 少于该点数不输出斜率
+
+// 注水速率估计：对最近若干 (t, a) 做最小二乘直线拟合
+typedef struct {
+    int16_t  a[FILL_RATE_WINDOW];
+    uint32_t t[FILL_RATE_WINDOW];
+    uint8_t  pos;
+    uint8_t  count;
+} FillRate_t;
+
+void fill_rate_reset(FillRate_t *fr);
+
+/**
+ * 加入一个带时间戳的距离读数
+ * @param a    传感器距离读数
+ * @param t_ms 读数时间（HAL_GetTick）
+ */
+void fill_rate_push(FillRate_t *fr, int a, uint32_t t_ms);
+
+/**
+ * 拟合斜率
+ * @param slope_per_s 输出：距离单位/秒（液面上升时为负）
+ * @return 1=有效，0=点数不足或时间跨度为0
+ */
+uint8_t fill_rate_slope(const FillRate_t *fr, int32_t *slope_per_s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FILL_RATE_H
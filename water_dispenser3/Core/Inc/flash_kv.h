@@ -0,0 +1,70 @@
+#ifndef FLASH_KV_H
+#define FLASH_KV_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 片内 Flash 最后两页上的日志结构键值存储
+ * - 两页轮流使用：写入只在当前页末尾追加，页满时把每个键的最新记录搬到另一页（压缩）
+ * - 记录：[key][len][data(补齐到偶数)][crc16]，先写 len/data/crc，最后写 key 作为提交
+ *   掉电时未写 key 的记录在启动扫描时被跳过
+ * - 页头：[erase_count][gen][copied][保留]，压缩顺序：擦除新页并写 erase_count → 写 gen=旧页+1
+ *   → 搬运（触发压缩的键直接写入新值）→ copied=0 → 擦除旧页；任一步掉电后启动都能恢复到唯一有效页
+ *   （copied 未写的页丢弃；两页都已 copied 时取 gen 较新的一页）
+ * - 启动时扫描一次建立 RAM 索引（键 -> 页内偏移），读取为 O(1)
+ * 擦写期间 CPU 取指停顿（半字编程约 50us，页擦除约 20ms），只应在不出水的状态下写入
+ */
+#define KV_PAGE_A        0x0800F800U   // 与链接脚本 KVSTORE 区域一致
+#define KV_PAGE_B        0x0800FC00U
+#define KV_PAGE_SIZE     1024U
+#define KV_MAX_KEYS      32            // 键取值 0..KV_MAX_KEYS-1
+#define KV_MAX_VALUE     32            // 单条记录最大字节数
+
+typedef enum {
+    KV_OK = 0,
+    KV_ERR_KEY,        // 键超出范围
+    KV_ERR_LEN,        // 长度超出范围或与存储的不一致
+    KV_ERR_NOTFOUND,
+    KV_ERR_FULL,       // 压缩后仍放不下
+    KV_ERR_FLASH       // HAL 擦写失败
+} KvStatus;
+
+typedef struct {
+    uint32_t writes;       // 追加的记录数（含压缩搬运）
+    uint32_t skipped;      // 与已存值相同而省去的写入
+    uint32_t compactions;
+    uint32_t erase_a;      // 各页累计擦除次数（保存在页头）
+    uint32_t erase_b;
+    uint32_t torn;         // 启动扫描发现的未提交/损坏记录
+    uint16_t used;         // 当前页已用字节
+    uint8_t  page;         // 当前页：0=A，1=B
+    uint8_t  keys;         // 当前有效键数
+} KvStats_t;
+
+/**
+ * 启动时调用：恢复中断的压缩、选出有效页并建立索引（空片则格式化）
+ */
+KvStatus kv_init(void);
+
+/**
+ * 读取一个键
+ * @param len 输入缓冲长度；输出实际长度
+ */
+KvStatus kv_get(uint16_t key, void *buf, uint16_t *len);
+
+/**
+ * 写入一个键（与已存值相同则不写），页满时先压缩
+ */
+KvStatus kv_put(uint16_t key, const void *buf, uint16_t len);
+
+const KvStats_t *kv_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FLASH_KV_H
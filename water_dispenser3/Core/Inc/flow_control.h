@@ -0,0 +1,44 @@
+#ifndef FLOW_CONTROL_H
+#define FLOW_CONTROL_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// TIM3 CH3 比较值范围（Period = 999）
+#define FLOW_DUTY_MAX        999   // 满速
+#define FLOW_DUTY_MIN        450   // 接近目标时的最低占空（再低水泵可能停转）
+#define FLOW_DUTY_START      400   // 软启动初值
+#define FLOW_SOFTSTART_MS    300   // 软启动时长
+#define FLOW_APPROACH_DIST   60    // 剩余距离小于该值开始减速（距离单位同 a）
+#define FLOW_SLEW_PER_FRAME  200   // 每帧占空最大变化量
+
+// 注水流量控制器：按剩余距离逐帧计算 CCR3
+typedef struct {
+    uint16_t duty;        // 当前占空（CCR3）
+    uint32_t start_ms;    // 开始注水时间
+    uint32_t last_ms;     // 上次更新时间
+    uint32_t full_ms;     // 满速累计时长
+    uint32_t duty_sum;    // 占空累计（按帧）
+    uint16_t frames;      // 更新帧数
+} FlowCtrl_t;
+
+/**
+ * 开始一次注水，返回软启动初始占空
+ */
+uint16_t flow_ctrl_start(FlowCtrl_t *fc, uint32_t now_ms);
+
+/**
+ * 每帧更新
+ * @param remaining 当前距离与停止距离之差（>0 表示尚未到达）
+ * @return 新的 CCR3 比较值
+ */
+uint16_t flow_ctrl_update(FlowCtrl_t *fc, int remaining, uint32_t now_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FLOW_CONTROL_H
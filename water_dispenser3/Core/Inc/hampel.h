@@ -0,0 +1,53 @@
+#ifndef HAMPEL_H
+#define HAMPEL_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Hampel 离群点门限：新样本与最近 HAMPEL_WINDOW 个样本的中位数之差
+ * 超过 K * 1.4826 * MAD 时判为离群，输出中位数代替。
+ * 窗口内维护一个有序副本，每个样本只做一次插入/删除（不整体排序），
+ * MAD 由中位数两侧的偏差序列归并得到。
+ *
+ * 真实阶跃：只靠中位数要等新电平占窗口多数（窗口 5 时拒绝 3 帧、第 4 帧才接受），
+ * 因此另加一致性接受：连续两帧都偏离中位数且彼此之差在门限内，视为阶跃，
+ * 从第 2 帧起接受，阶跃只被拒绝 HAMPEL_STEP_LAG 帧。
+ * 代价是两帧相同的离群值会被放过（溅射回波通常不会连续两帧落在同一距离）。
+ */
+#define HAMPEL_WINDOW    5        // 历史窗口（奇数，<=15）
+#define HAMPEL_MIN_COUNT 3        // 历史不足时直接接受
+#define HAMPEL_T_Q8      1139     // K * 1.4826，K=3（Q8）
+#define HAMPEL_MAD_MIN   3        // MAD 下限：读数完全相同时不致把正常抖动当离群
+#define HAMPEL_STEP_LAG  1        // 真实阶跃被拒绝的帧数（计入停泵延迟预算）
+
+typedef struct {
+    int16_t  ring[HAMPEL_WINDOW];    // 按时间顺序
+    int16_t  sorted[HAMPEL_WINDOW];  // 有序副本
+    uint8_t  pos;
+    uint8_t  count;
+    int16_t  median;                 // 最近一次判决用的中位数
+    int16_t  mad;                    // 最近一次判决用的 MAD
+    int16_t  prev_raw;               // 上一个原始样本
+    uint8_t  prev_off;               // 上一个样本偏离中位数（不论是否因一致性被接受）
+    uint32_t total;
+    uint32_t rejected;
+} Hampel_t;
+
+void hampel_reset(Hampel_t *h);
+
+/**
+ * 判决并记录一个样本（原始样本总是进入窗口；阶跃的第 2 帧起即被接受）
+ * @param out 输出：接受时为原值，离群时为中位数
+ * @return 1=接受，0=离群
+ */
+uint8_t hampel_filter(Hampel_t *h, int x, int *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HAMPEL_H
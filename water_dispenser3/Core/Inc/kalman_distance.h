@@ -0,0 +1,71 @@
+#ifndef KALMAN_DISTANCE_H
+#define KALMAN_DISTANCE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 距离的匀速模型卡尔曼滤波（定点）
+ * 状态：距离 d 与速率 v（距离单位/秒）；观测：传感器读数 a
+ * 观测噪声随回波强度 b 变化：回波越强噪声越小
+ * 定点格式：d、v、新息为 Q8；协方差为 Q8（距离单位²，及其 /s、/s² 形式）
+ */
+#define KF_Q             256
+#define KF_R_BASE        (64 * KF_Q)    // 参考回波强度下的观测方差（σ≈8）
+#define KF_B_REF         1000           // 参考回波强度
+#define KF_B_MIN         100            // 回波强度下限（防止方差过大）
+#define KF_B_MAX         8000
+#define KF_R_UNKNOWN_MUL 2              // 未知 b（仅 a 更新）时观测方差倍数
+#define KF_Q_D           (2 * KF_Q)     // 每帧距离过程噪声
+#define KF_Q_V           (400 * KF_Q)   // 速率过程噪声（每秒，单位²/s²）
+#define KF_P_INIT        (10000 * KF_Q) // 冷启动距离方差（σ=100）
+#define KF_PV_INIT       (2500 * KF_Q)  // 冷启动速率方差（σ=50/s）
+#define KF_P_REINIT      (400 * KF_Q)   // 状态切换时距离方差下限（σ=20），1~2帧即可收敛
+#define KF_DT_MAX_MS     1000           // 帧间隔上限（长时间无数据时不外推过远）
+
+typedef struct {
+    int32_t  d_q;        // 距离 Q8
+    int32_t  v_q;        // 速率 Q8（单位/秒，液面上升时为负）
+    int32_t  p00, p01, p11;
+    int32_t  innov_q;    // 最近一次新息（观测 - 预测）Q8
+    uint32_t last_ms;
+    uint8_t  init;
+} KalmanDist_t;
+
+void kalman_dist_reset(KalmanDist_t *kf);
+
+/**
+ * 输入一次观测
+ * @param a    距离读数
+ * @param b    回波强度；<0 表示未知
+ * @param t_ms 观测时间
+ */
+void kalman_dist_update(KalmanDist_t *kf, int a, int b, uint32_t t_ms);
+
+// 只做预测（观测被剔除时调用）：按匀速外推距离并放大协方差，新息保持上一次的值
+void kalman_dist_predict(KalmanDist_t *kf, uint32_t t_ms);
+
+// 状态切换时调用：保留估计，只放大距离方差，使滤波器快速跟上新工况
+void kalman_dist_reinit(KalmanDist_t *kf);
+
+/**
+ * 下一帧的停止门限（不修改滤波器）：下一帧观测 a < 返回值时，更新后的估计距离将小于 d_stop
+ * 供中断侧快速停泵按同一估计器判断
+ * @param b          预计回波强度（取最近一帧）
+ * @param t_ms       下一帧的预计时间
+ * @param pred_below 输出：下一帧若被剔除（只做预测），估计是否已小于 d_stop
+ */
+int kalman_dist_stop_threshold(const KalmanDist_t *kf, int d_stop, int b, uint32_t t_ms, uint8_t *pred_below);
+
+static inline int kalman_dist_distance(const KalmanDist_t *kf) { return (int)((kf->d_q + KF_Q / 2) >> 8); }
+static inline int32_t kalman_dist_rate(const KalmanDist_t *kf) { return kf->v_q / KF_Q; }
+static inline int kalman_dist_innovation(const KalmanDist_t *kf) { return (int)(kf->innov_q / KF_Q); }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // KALMAN_DISTANCE_H
@@ -0,0 +1,52 @@
+#ifndef MA_BANK_H
+#define MA_BANK_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 多速率滑动平均：一份共享历史同时维护多个窗口的和，每个样本 O(抽头数)。
+ * 各状态只选择需要的输出，切换时无需清零、无预热空档。
+ */
+#define MA_BANK_HIST   16               // 共享历史长度（=最大窗口）
+#define MA_BANK_TAPS   3
+
+// 各抽头窗口（升序，最大值不超过 MA_BANK_HIST）
+#define MA_BANK_WINDOWS { 3, 8, 16 }
+
+typedef struct {
+    int16_t  hist[MA_BANK_HIST];
+    uint8_t  pos;                       // 下一个写入位置
+    uint8_t  count;                     // 已有样本数（封顶 MA_BANK_HIST）
+    int32_t  sum[MA_BANK_TAPS];
+} MaBank_t;
+
+void ma_bank_reset(MaBank_t *mb);
+void ma_bank_push(MaBank_t *mb, int a);
+
+// 窗口长度 -> 抽头号（取不小于 window 的最小抽头；超出取最大）
+uint8_t ma_bank_tap(uint16_t window);
+uint8_t ma_bank_window(uint8_t tap);
+
+/**
+ * 抽头输出；样本不足窗口时按已有样本平均
+ * @return 平均值；无样本时返回 0
+ */
+int ma_bank_get(const MaBank_t *mb, uint8_t tap);
+
+// 该抽头的窗口是否已填满
+uint8_t ma_bank_ready(const MaBank_t *mb, uint8_t tap);
+
+/**
+ * 下一个样本的停止门限（窗口须已填满）：下一个样本 a < 返回值时，该抽头输出将小于 target
+ */
+int ma_bank_stop_threshold(const MaBank_t *mb, uint8_t tap, int target);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MA_BANK_H
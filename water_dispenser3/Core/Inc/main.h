@@ -53,6 +53,8 @@ extern "C" {
 void Error_Handler(void);
 
 /* USER CODE BEGIN EFP */
+void app_uart1_idle_isr(void);
+void pump_stop(void);
 
 /* USER CODE END EFP */
 
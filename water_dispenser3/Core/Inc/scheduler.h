@@ -0,0 +1,65 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 最大任务数（静态分配）
+#define SCHED_MAX_JOBS   12
+#define SCHED_NO_JOB     (-1)
+#define SCHED_IDLE       0xFFFFFFFFu  // 没有任何已启动的任务
+
+typedef void (*SchedFn)(uint32_t now);
+
+// 单个任务：period_ms==0 为单次任务，到期执行一次后自动停止
+typedef struct {
+    const char *name;
+    SchedFn     fn;
+    uint32_t    period_ms;
+    uint32_t    deadline;
+    int8_t      next;          // 按到期时间排序的链表
+    uint8_t     active;
+    // 运行时间统计（DWT 周期）
+    uint32_t    runs;
+    uint32_t    cyc_total;
+    uint32_t    cyc_max;
+    uint32_t    late_max_ms;   // 实际执行时间相对到期时间的最大滞后
+} SchedJob_t;
+
+void sched_init(void);
+
+/**
+ * 注册任务（注册后处于停止状态）
+ * @return 任务号；任务表已满时返回 SCHED_NO_JOB
+ */
+int8_t sched_create(const char *name, SchedFn fn, uint32_t period_ms);
+
+/**
+ * 启动/重新启动任务：delay_ms 后首次执行
+ * 已启动的任务会被重新排到新的到期时间（用于“喂狗”式超时）
+ */
+void sched_start(int8_t id, uint32_t now, uint32_t delay_ms);
+void sched_cancel(int8_t id);
+uint8_t sched_active(int8_t id);
+
+/**
+ * 执行所有已到期的任务
+ * @return 距下一个到期时间的毫秒数；无任务时返回 SCHED_IDLE
+ */
+uint32_t sched_run(uint32_t now);
+
+// 距下一个到期时间的毫秒数（已到期返回0；无任务返回 SCHED_IDLE）
+uint32_t sched_next_in(uint32_t now);
+
+// 读取任务统计；id 越界返回 NULL
+const SchedJob_t *sched_job(int8_t id);
+int8_t sched_job_count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SCHEDULER_H
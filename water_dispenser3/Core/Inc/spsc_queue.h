@@ -0,0 +1,67 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 容量必须为2的幂（下标用掩码取模，计数器自然回绕）
+#define SPSC_CAPACITY   16
+#define SPSC_MASK       (SPSC_CAPACITY - 1)
+
+#if (SPSC_CAPACITY & SPSC_MASK) != 0
+#error "SPSC_CAPACITY must be a power of two"
+#endif
+
+// 中断 -> 主循环 的事件类型
+typedef enum {
+    SPSC_EV_NONE = 0,
+    SPSC_EV_FRAME_READY,   // USART1 空闲：一帧（或一段）数据已进入 DMA 缓冲，arg=DMA写位置
+    SPSC_EV_AT_RESPONSE,   // 同上，但 AT 序列进行中，arg=DMA写位置
+    SPSC_EV_UART_ERROR,    // USART1 错误，arg=HAL ErrorCode
+    SPSC_EV_CUTOFF,        // 快速停泵已在中断中关断水泵
+    // 定时任务由 scheduler 按 HAL_GetTick 在主循环中轮询，没有定时器中断事件
+} SpscEventType;
+
+typedef struct {
+    uint8_t  type;
+    uint32_t arg;
+} SpscEvent_t;
+
+/*
+ * 单生产者/单消费者无锁环形队列
+ * head 只由生产者写，tail 只由消费者写；两者都是单调递增的计数，
+ * head - tail 即队列中元素个数
+ */
+typedef struct {
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    uint32_t overflow;      // 队列满被丢弃的事件数（生产者侧写）
+    uint32_t high_water;    // 曾达到的最大深度（生产者侧写）
+    SpscEvent_t buf[SPSC_CAPACITY];
+} SpscQueue_t;
+
+void spsc_init(SpscQueue_t *q);
+
+/**
+ * 生产者：写入一个事件
+ * @return 1=成功，0=队列满（overflow 计数加一）
+ */
+uint8_t spsc_push(SpscQueue_t *q, const SpscEvent_t *ev);
+
+/**
+ * 消费者：取出一个事件
+ * @return 1=取到，0=队列空
+ */
+uint8_t spsc_pop(SpscQueue_t *q, SpscEvent_t *ev);
+
+// 消费者侧查询是否为空
+uint8_t spsc_empty(const SpscQueue_t *q);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SPSC_QUEUE_H
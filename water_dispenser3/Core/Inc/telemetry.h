@@ -0,0 +1,110 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * USART2 二进制遥测：定长结构体记录，COBS 成帧，0x00 为帧分隔
+ * 帧内容（COBS 编码前）：[type][seq][t_ms 4字节][payload][crc8]，多字节字段小端
+ * seq 逐帧 +1，上位机据此统计丢帧；上位机解码见 Tools/Algo_Simulation/telemetry_decode.py
+ */
+#define TLM_MAX_PAYLOAD   80
+#define TLM_HDR_LEN       6
+#define TLM_MAX_FRAME     (TLM_HDR_LEN + TLM_MAX_PAYLOAD + 1 + 2 + 1) // + crc + COBS 开销 + 分隔符
+
+// 记录类型（上位机保持一致）
+typedef enum {
+    TLM_T_TEXT = 1,      // 文本（DEBUG_PRINT 的输出，超长时分段）
+    TLM_T_FRAME,         // TlmFrame_t
+    TLM_T_STATE,         // TlmState_t
+    TLM_T_THRESH,        // TlmThresh_t
+    TLM_T_METRIC,        // TlmMetric_t
+    TLM_T_LOG            // 延迟格式化日志：[格式串编号 u16][参数]（deferred_log.h）
+} TlmType_e;
+
+// 指标编号
+typedef enum {
+    TLM_M_TTD = 1,           // 放杯确认 -> 首次出水（ms）
+    TLM_M_STOP_ERROR,        // 停泵误差（距离单位）
+    TLM_M_ARMED_AT,          // MEASURE 降敏结束时间（ms）
+    TLM_M_BOOT_FIRST_FRAME   // 复位 -> 首个解析帧（ms），aux：0=冷启动 1=热启动 2=热启动跳过初始化
+} TlmMetric_e;
+
+typedef struct __attribute__((packed)) {
+    int16_t a;
+    int16_t b;               // -1 表示本帧只有 a
+    int16_t a_filtered;
+    int16_t rate;            // 卡尔曼速度（距离单位/秒）
+    int16_t innov;           // 卡尔曼新息
+    uint8_t state;
+} TlmFrame_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t  prev;
+    uint8_t  next;
+    uint32_t dwell_ms;
+} TlmState_t;
+
+typedef struct __attribute__((packed)) {
+    int16_t edge_idx;
+    int16_t liquid_idx;
+    int16_t x;
+    int16_t t1;
+    int16_t y;
+    int16_t t2;
+    int16_t sep;
+    int16_t t1_headroom;
+    int16_t edge_distance;
+    int16_t cup_depth;
+    int16_t alarm_distance;
+    int16_t stop_distance;
+    uint8_t peak_count;
+    uint8_t edge_extension;
+    uint8_t edge_prom_pct;
+    uint8_t liquid_prom_pct;
+    uint8_t confidence;
+    uint8_t strong_echo;
+    uint8_t cache_hit;
+} TlmThresh_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t id;
+    int32_t value;
+    int32_t aux;             // 附加值（如 TTD 的验证路径、停泵误差的提前量）
+} TlmMetric_t;
+
+typedef struct {
+    uint32_t packets;
+    uint32_t payload;        // 有效载荷字节
+    uint32_t bytes;          // 线上字节（含头、CRC、COBS 开销与分隔符）
+    uint32_t enc_cyc;        // 编码耗时（DWT 周期，不含发送）
+} TlmStats_t;
+
+/**
+ * @param write 输出函数（把一整帧交给串口发送或发送队列）
+ */
+void tlm_init(void (*write)(const uint8_t *data, uint16_t len));
+
+/**
+ * 编码一帧（不发送）
+ * @param out 至少 TLM_MAX_FRAME 字节
+ * @return 帧长度（含末尾 0x00），payload 过长返回 0
+ */
+uint16_t tlm_encode(uint8_t type, uint8_t seq, uint32_t t_ms, const void *payload, uint16_t len, uint8_t *out);
+
+void tlm_send(uint8_t type, const void *payload, uint16_t len);
+
+// 文本按 TLM_MAX_PAYLOAD 分段发送
+void tlm_text(const char *s, uint16_t len);
+
+const TlmStats_t *tlm_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TELEMETRY_H
@@ -18,6 +18,12 @@ extern "C" {
 #define MIN_PROMINENCE    60
 #define MAX_PEAKS         32                   // 足够覆盖典型波形中峰数量
 
+// 置信度参数：各分项达到该值即记满分（100）
+#define CONF_SEP_FULL         20   // 液位峰到 x 的间隔（点）
+#define CONF_PROM_FULL_PCT    60   // 边沿/液位峰 prominence 占峰值的百分比
+#define CONF_HEADROOM_FULL_PCT 40  // t1 对 [MIN_I, x] 内最强原始采样的余量，占设计余量（0.15 倍边沿幅度）的百分比
+#define CONF_EXTENSION_CAP    50   // 边沿被干扰峰扩展时置信度上限
+
 // 峰角色
 typedef enum {
     ROLE_UNKNOWN = 0,
@@ -45,10 +51,37 @@ typedef struct {
     int16_t t2;          // 干扰阈值
     int16_t y;           // 干扰区间右边界（全局索引）
     uint8_t edge_extension; // 1 表示边沿被右侧更高干扰峰扩展（使用干扰峰构成边沿簇）
+    // 裕量与置信度（新增）：用于决定是否跳过/缩短 VERIFY
+    int16_t sep;             // 液位峰与 x 的间隔（点），越大越不易把液面当边沿
+    int16_t edge_prom_pct;   // 边沿峰 prominence/amp（%）
+    int16_t liquid_prom_pct; // 液位峰 prominence/amp（%）
+    int16_t t1_headroom;     // t1 - max(raw[MIN_I..x])，负值说明原始毛刺已能突破 t1
+    uint8_t confidence;      // 0~100，各分项得分取最小值
     Peak_t  peaks[MAX_PEAKS];
     uint8_t peak_count;
 } ThresholdResult_t;
 
+// 液位回波跟踪参数
+#define TRACK_SEARCH_LEFT   6     // 搜索窗：上一位置左侧点数（液面上升时峰向边沿移动）
+#define TRACK_SEARCH_RIGHT  3     // 搜索窗：上一位置右侧点数
+#define TRACK_MIN_AMP       (BASE_THRESHOLD / 2) // 窗内峰值低于此值视为本帧丢失
+#define TRACK_LOST_MAX      3     // 连续丢失帧数超过该值则失锁
+#define TRACK_Q             16    // 位置定点倍数（Q4，1/16 点）
+
+// 液位回波跟踪器：在 MEASURE 阶段逐帧跟随液位峰
+typedef struct {
+    int32_t idx_q;       // 液位峰位置（全局索引 * TRACK_Q，抛物线插值亚点精度）
+    int16_t amp;         // 当前峰值幅度
+    int32_t start_q;     // 开始跟踪时的位置（空杯液面）
+    int32_t full_q;      // 满杯位置（x 右边界）
+    int16_t edge_limit;  // 搜索下限（边沿峰右侧，全局索引）
+    int16_t level_pct;   // 液位 0~100%（start -> full）
+    int32_t rate_q;      // 液面上升速率（TRACK_Q 点/秒，正值表示上升），一阶平滑
+    uint32_t last_ms;    // 上次更新时间
+    uint8_t locked;      // 1=跟踪有效
+    uint8_t lost_count;  // 连续丢失帧数
+} LiquidTracker_t;
+
 /**
  * 计算阈值（按新 Python 版本算法）
  * @param raw_data 输入原始数据（至少需要覆盖到 MAX_I 索引，典型 224 点）
@@ -57,6 +90,25 @@ typedef struct {
  */
 void compute_thresholds(const int16_t *raw_data, int16_t raw_len, ThresholdResult_t *result);
 
+/**
+ * 用 CONFIGURE 的结果初始化液位跟踪器
+ * @param trk    跟踪器
+ * @param result compute_thresholds 的输出（需含 edge_idx/liquid_idx）
+ * @param now_ms 当前时间
+ */
+void liquid_tracker_init(LiquidTracker_t *trk, const ThresholdResult_t *result, uint32_t now_ms);
+
+/**
+ * 逐帧更新：仅在上一位置附近的小窗口内搜索，开销远小于 compute_thresholds
+ * @return 1=本帧跟踪成功，0=本帧丢失（或已失锁）
+ */
+uint8_t liquid_tracker_update(LiquidTracker_t *trk, const int16_t *raw_data, int16_t raw_len, uint32_t now_ms);
+
+/**
+ * 把跟踪位置换算为与传感器 a 相同量纲的距离（idx*430/225）
+ */
+int liquid_tracker_distance(const LiquidTracker_t *trk);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,57 @@
+#ifndef WARM_BOOT_H
+#define WARM_BOOT_H
+
+#include "main.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 热启动快照：主动复位前把少量状态写入备份域 BKP 数据寄存器（系统复位不清除，掉电清除）
+ * 上电时结合 RCC 复位标志区分冷/热启动；快照读取后立即作废，只使用一次
+ */
+#define WARM_MAGIC        0x5742U
+
+// 复位原因
+typedef enum {
+    WARM_REASON_NONE = 0,
+    WARM_REASON_NO_PARSE,     // 无解析看门狗
+    WARM_REASON_USER          // 其他主动复位
+} WarmReason_e;
+
+#define WARM_FLAG_SENSOR_DEFAULT  0x0001U  // 传感器处于默认配置（DETECT 的 AT 序列已完成）
+
+typedef struct {
+    uint16_t reason;
+    uint16_t state;           // 复位前的 AppState
+    uint16_t flags;
+    int16_t  x;               // 最近一次下发的杯子配置 S3/T2/S4/T3（传感器当前是否为默认配置见 flags）
+    int16_t  t1;
+    int16_t  y;
+    int16_t  t2;
+} WarmSnapshot_t;
+
+/**
+ * 上电尽早调用：打开备份域访问，锁存并清除 RCC 复位标志
+ * @return 1=热启动（软件/看门狗复位，且不是上电复位）
+ */
+uint8_t warm_boot_init(void);
+
+// 本次复位时的 RCC->CSR（复位标志位）
+uint32_t warm_boot_reset_flags(void);
+
+/**
+ * 读取并作废快照
+ * @return 1=快照有效（仅热启动时可能有效）
+ */
+uint8_t warm_boot_take(WarmSnapshot_t *s);
+
+// 复位前调用
+void warm_boot_save(const WarmSnapshot_t *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WARM_BOOT_H
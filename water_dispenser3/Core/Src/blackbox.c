@@ -0,0 +1,234 @@
+#include "blackbox.h"
+#include "main.h"
+#include <string.h>
+
+static BbRecord_t ring[BB_RING_LEN];
+static uint32_t   ring_head = 0;     // 累计写入条数（下标取低位）
+
+// BKP 数据寄存器（低 16 位）：导出后的转储次数，系统复位保留、掉电清零（DR1..DR9 归 warm_boot）
+#define BKP_FLUSHES  (BKP->DR10)
+
+static inline const BbHeader_t *saved_hdr(void) {
+    return (const BbHeader_t *)(uintptr_t)BB_FLASH_ADDR;
+}
+
+static inline const BbRecord_t *saved_rec(void) {
+    return (const BbRecord_t *)(uintptr_t)(BB_FLASH_ADDR + sizeof(BbHeader_t));
+}
+
+static int16_t sat16(int32_t v) {
+    if (v > 32767) return 32767;
+    if (v < -32768) return -32768;
+    return (int16_t)v;
+}
+
+// CRC-16/CCITT-FALSE
+static uint16_t crc16(uint16_t crc, const uint8_t *p, uint32_t n) {
+    while (n--) {
+        crc ^= (uint16_t)(*p++) << 8;
+        for (uint8_t i = 0; i < 8; i++) {
+            crc = (crc & 0x8000U) ? (uint16_t)((crc << 1) ^ 0x1021U) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+void bb_log(uint8_t type, uint8_t arg, int32_t v0, int32_t v1, int32_t v2) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    BbRecord_t *r = &ring[ring_head & (BB_RING_LEN - 1)];
+    ring_head++;
+    r->t_ms = HAL_GetTick();
+    r->type = type;
+    r->arg = arg;
+    r->v[0] = sat16(v0);
+    r->v[1] = sat16(v1);
+    r->v[2] = sat16(v2);
+    __set_PRIMASK(primask);
+}
+
+// 按时间先后取第 i 条（共 n 条）
+static const BbRecord_t *ring_at(uint32_t n, uint32_t i) {
+    return &ring[(ring_head - n + i) & (BB_RING_LEN - 1)];
+}
+
+static uint32_t ring_count(void) {
+    return (ring_head < BB_RING_LEN) ? ring_head : BB_RING_LEN;
+}
+
+/* ---- FPEC 寄存器直接擦写 ----
+ * 不经过 HAL：HardFault 可能发生在 HAL 擦写过程中（pFlash 已上锁），HAL 接口会直接返回 HAL_BUSY */
+
+static void fpec_wait(void) {
+    while (FLASH->SR & FLASH_SR_BSY) {}
+    FLASH->SR = FLASH_SR_EOP | FLASH_SR_PGERR | FLASH_SR_WRPRTERR; // 写 1 清除
+}
+
+static void fpec_unlock(void) {
+    fpec_wait(); // 被打断的操作先完成
+    if (FLASH->CR & FLASH_CR_LOCK) {
+        FLASH->KEYR = FLASH_KEY1;
+        FLASH->KEYR = FLASH_KEY2;
+    }
+    FLASH->CR &= ~(FLASH_CR_PG | FLASH_CR_PER | FLASH_CR_MER);
+}
+
+static void fpec_lock(void) {
+    FLASH->CR |= FLASH_CR_LOCK;
+}
+
+static uint8_t fpec_erase_page(uint32_t addr) {
+    FLASH->CR |= FLASH_CR_PER;
+    FLASH->AR = addr;
+    FLASH->CR |= FLASH_CR_STRT;
+    fpec_wait();
+    FLASH->CR &= ~FLASH_CR_PER;
+    return *(volatile const uint32_t *)(uintptr_t)addr == 0xFFFFFFFFU;
+}
+
+static uint8_t fpec_prog16(uint32_t addr, uint16_t v) {
+    FLASH->CR |= FLASH_CR_PG;
+    *(volatile uint16_t *)(uintptr_t)addr = v;
+    fpec_wait();
+    FLASH->CR &= ~FLASH_CR_PG;
+    return *(volatile const uint16_t *)(uintptr_t)addr == v;
+}
+
+static uint8_t prog_block(uint32_t addr, const void *src, uint32_t len) {
+    const uint8_t *p = (const uint8_t *)src;
+    for (uint32_t i = 0; i < len; i += 2) {
+        uint16_t hw = p[i] | (uint16_t)(((i + 1 < len) ? p[i + 1] : 0xFFU) << 8);
+        if (!fpec_prog16(addr + i, hw)) return 0;
+    }
+    return 1;
+}
+
+// 备份域访问（warm_boot_init 已打开时重复设置无副作用；HardFault 中同样可用）
+static void bkp_access(void) {
+    RCC->APB1ENR |= RCC_APB1ENR_PWREN | RCC_APB1ENR_BKPEN;
+    PWR->CR |= PWR_CR_DBP;
+}
+
+// 缓冲中是否有启动/看门狗/转储/AT 序列完成之外的记录（无解析复位循环中只有这些，不值得擦写）
+static uint8_t ring_has_news(void) {
+    uint32_t n = ring_count();
+    for (uint32_t i = 0; i < n; i++) {
+        const BbRecord_t *r = ring_at(n, i);
+        if (r->type == BB_EV_BOOT || r->type == BB_EV_WDOG || r->type == BB_EV_FLUSH) continue;
+        if (r->type == BB_EV_AT && r->arg == 0) continue;
+        return 1;
+    }
+    return 0;
+}
+
+uint8_t bb_flush(uint8_t reason) {
+    // 转储策略（Flash 寿命约 1 万次擦写，且不能覆盖还没看过的现场）
+    const BbHeader_t *old = bb_saved();
+    if (!ring_has_news()) return 0;
+    if (old && old->exported == BB_NOT_EXPORTED && !(reason == BB_FLUSH_FAULT && old->reason != BB_FLUSH_FAULT)) {
+        return 0; // 未导出的转储只允许被 HardFault 现场替换一次
+    }
+    bkp_access();
+    uint16_t flushes = (uint16_t)BKP_FLUSHES;
+    if (flushes >= BB_FLUSH_MAX) return 0;
+    BKP_FLUSHES = flushes + 1U;
+
+    bb_log(BB_EV_FLUSH, reason, 0, 0, 0);
+
+    BbHeader_t hdr;
+    memset(&hdr, 0xFF, sizeof(hdr));
+    hdr.magic = BB_MAGIC;
+    hdr.seq = old ? old->seq + 1 : 1;
+    hdr.t_ms = HAL_GetTick();
+    hdr.reason = reason;
+
+    uint8_t ok = 1;
+    fpec_unlock();
+    for (uint32_t a = BB_FLASH_ADDR; ok && a < BB_FLASH_ADDR + BB_FLASH_SIZE; a += FLASH_PAGE_SIZE) {
+        ok = fpec_erase_page(a);
+    }
+    if (ok) {
+        // 直接从环形缓冲按时间顺序写入：关中断期间不会有新记录（之后的记录不进入本次转储）
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        uint32_t n = ring_count();
+        uint16_t crc = 0xFFFFU;
+        uint32_t addr = BB_FLASH_ADDR + sizeof(BbHeader_t);
+        for (uint32_t i = 0; ok && i < n; i++, addr += sizeof(BbRecord_t)) {
+            const BbRecord_t *r = ring_at(n, i);
+            crc = crc16(crc, (const uint8_t *)r, sizeof(BbRecord_t));
+            ok = prog_block(addr, r, sizeof(BbRecord_t));
+        }
+        __set_PRIMASK(primask);
+        hdr.count = (uint16_t)n;
+        hdr.crc = crc;
+        if (ok) ok = prog_block(BB_FLASH_ADDR, &hdr, sizeof(hdr)); // 头部最后写：写完才算有效
+    }
+    fpec_lock();
+    return ok;
+}
+
+const BbHeader_t *bb_saved(void) {
+    const BbHeader_t *h = saved_hdr();
+    if (h->magic != BB_MAGIC || h->count > (BB_FLASH_SIZE - sizeof(BbHeader_t)) / sizeof(BbRecord_t)) return NULL;
+    if (crc16(0xFFFFU, (const uint8_t *)saved_rec(), h->count * sizeof(BbRecord_t)) != h->crc) return NULL;
+    return h;
+}
+
+/* ---- 导出 ---- */
+
+static char *put_hex(char *o, const void *src, uint32_t len) {
+    static const char hex[] = "0123456789ABCDEF";
+    const uint8_t *p = (const uint8_t *)src;
+    for (uint32_t i = 0; i < len; i++) {
+        *o++ = hex[p[i] >> 4];
+        *o++ = hex[p[i] & 0x0F];
+    }
+    return o;
+}
+
+static void dump_line(void (*write)(const uint8_t *, uint16_t), const char *prefix,
+                      const void *data, uint32_t len) {
+    char line[8 + 2 * sizeof(BbHeader_t) + 2];
+    uint32_t plen = strlen(prefix);
+    memcpy(line, prefix, plen);
+    char *o = put_hex(line + plen, data, len);
+    *o++ = '\r';
+    *o++ = '\n';
+    write((const uint8_t *)line, (uint16_t)(o - line));
+}
+
+void bb_dump(void (*write)(const uint8_t *data, uint16_t len)) {
+    const BbHeader_t *h = bb_saved();
+    if (h) {
+        dump_line(write, "BB,H,F,", h, sizeof(*h));
+        for (uint16_t i = 0; i < h->count; i++) dump_line(write, "BB,F,", &saved_rec()[i], sizeof(BbRecord_t));
+        if (h->exported == BB_NOT_EXPORTED) {
+            // 已导出：之后的复位/看门狗可以覆盖（头部不在 CRC 范围内，原位写 0 无需擦除）
+            fpec_unlock();
+            fpec_prog16((uint32_t)(uintptr_t)&h->exported, 0);
+            fpec_lock();
+        }
+    }
+    bkp_access();
+    BKP_FLUSHES = 0;
+
+    // 当前 RAM 缓冲：逐条复制后发送（发送期间可能有新记录写入）
+    BbHeader_t rh;
+    memset(&rh, 0xFF, sizeof(rh));
+    rh.magic = BB_MAGIC;
+    rh.seq = 0;
+    rh.t_ms = HAL_GetTick();
+    uint32_t n = ring_count();
+    rh.count = (uint16_t)n;
+    rh.reason = 0;
+    dump_line(write, "BB,H,R,", &rh, sizeof(rh));
+    for (uint32_t i = 0; i < n; i++) {
+        BbRecord_t r;
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        r = *ring_at(n, i);
+        __set_PRIMASK(primask);
+        dump_line(write, "BB,R,", &r, sizeof(r));
+    }
+}
@@ -0,0 +1,97 @@
+#include "cup_cache.h"
+#include <stddef.h>
+#include <string.h>
+
+static int16_t abs16(int v) {
+    return (int16_t)(v < 0 ? -v : v);
+}
+
+// 幅度差是否在容差内（按较大者的百分比）
+static uint8_t amp_close(int a, int b) {
+    int ref = (a > b) ? a : b;
+    return abs16(a - b) * 100 <= ref * CUP_SIG_AMP_TOL_PCT;
+}
+
+// 容差内返回距离（越小越接近），超出容差返回 -1
+static int sig_distance(const CupSig_t *p, const CupSig_t *q) {
+    int de = abs16(p->edge_idx - q->edge_idx);
+    int dl = abs16(p->liquid_idx - q->liquid_idx);
+    int dp = abs16(p->peak_count - q->peak_count);
+
+    if (de > CUP_SIG_IDX_TOL || dl > CUP_SIG_IDX_TOL || dp > CUP_SIG_PEAKS_TOL) return -1;
+    if (!amp_close(p->edge_amp, q->edge_amp) || !amp_close(p->liquid_amp, q->liquid_amp)) return -1;
+    return de + dl + dp;
+}
+
+static int16_t peak_amp(const ThresholdResult_t *r, int16_t idx) {
+    if (idx < 0) return 0;
+    for (uint8_t i = 0; i < r->peak_count && i < MAX_PEAKS; i++) {
+        if (r->peaks[i].idx == idx) return r->peaks[i].amp;
+    }
+    return 0;
+}
+
+void cup_cache_init(CupCache_t *c) {
+    memset(c, 0, sizeof(*c));
+}
+
+void cup_sig_from_result(const ThresholdResult_t *r, CupSig_t *sig) {
+    sig->edge_idx = r->edge_idx;
+    sig->liquid_idx = r->liquid_idx;
+    sig->edge_amp = peak_amp(r, r->edge_idx);
+    sig->liquid_amp = peak_amp(r, r->liquid_idx);
+    sig->peak_count = r->peak_count;
+}
+
+static CupCacheEntry_t *nearest(CupCache_t *c, const CupSig_t *sig) {
+    CupCacheEntry_t *best = NULL;
+    int best_d = 0;
+    for (int i = 0; i < CUP_CACHE_SIZE; i++) {
+        CupCacheEntry_t *e = &c->entries[i];
+        if (!e->used) continue;
+        int d = sig_distance(&e->sig, sig);
+        if (d < 0) continue;
+        if (best == NULL || d < best_d) {
+            best = e;
+            best_d = d;
+        }
+    }
+    return best;
+}
+
+CupCacheEntry_t *cup_cache_find(CupCache_t *c, const CupSig_t *sig) {
+    c->lookups++;
+    CupCacheEntry_t *e = nearest(c, sig);
+    if (e) {
+        c->hits++;
+        if (e->hits < 0xFFFF) e->hits++;
+        e->stamp = ++c->clock;
+    }
+    return e;
+}
+
+CupCacheEntry_t *cup_cache_store(CupCache_t *c, const CupSig_t *sig,
+                                 int x, int t1, int y, int t2,
+                                 int stop_distance, uint8_t edge_extension) {
+    CupCacheEntry_t *e = nearest(c, sig);
+    if (e == NULL) {
+        // 空位优先，否则替换最久未用项
+        e = &c->entries[0];
+        for (int i = 0; i < CUP_CACHE_SIZE; i++) {
+            CupCacheEntry_t *k = &c->entries[i];
+            if (!k->used) { e = k; break; }
+            if (k->stamp < e->stamp) e = k;
+        }
+        e->hits = 0;
+    }
+    e->sig = *sig;
+    e->x = (int16_t)x;
+    e->t1 = (int16_t)t1;
+    e->y = (int16_t)y;
+    e->t2 = (int16_t)t2;
+    e->stop_distance = (int16_t)stop_distance;
+    e->edge_extension = edge_extension;
+    e->used = 1;
+    e->stamp = ++c->clock;
+    return e;
+}
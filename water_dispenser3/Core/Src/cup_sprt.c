@@ -0,0 +1,33 @@
+#include "cup_sprt.h"
+
+void cup_sprt_reset(CupSprt_t *s) {
+    s->llr = 0;
+    s->frames = 0;
+}
+
+int32_t cup_sprt_frame_llr(int a, int b) {
+    if (a <= 0) return 0; // 无回波：不提供证据
+
+    const int32_t mid = (SPRT_MU_EMPTY + SPRT_MU_CUP) / 2;
+    int32_t llr = (int32_t)(SPRT_MU_EMPTY - SPRT_MU_CUP) * SPRT_Q * (mid - a)
+                / (SPRT_SIGMA * SPRT_SIGMA);
+
+    if (b < SPRT_B_WEAK) llr /= 2;
+    if (llr > SPRT_LLR_CLIP) llr = SPRT_LLR_CLIP;
+    if (llr < -SPRT_LLR_CLIP) llr = -SPRT_LLR_CLIP;
+    return llr;
+}
+
+SprtDecision cup_sprt_update(CupSprt_t *s, int a, int b) {
+    s->llr += cup_sprt_frame_llr(a, b);
+    if (s->frames < 0xFFFF) s->frames++;
+
+    if (s->llr >= SPRT_UPPER) {
+        return SPRT_CUP;
+    }
+    if (s->llr <= SPRT_LOWER) {
+        cup_sprt_reset(s); // 空腔：重新开始，等待下一次放杯
+        return SPRT_EMPTY;
+    }
+    return SPRT_CONTINUE;
+}
@@ -0,0 +1,45 @@
+#include "debounce.h"
+
+void debounce_init(Debounce_t *d, uint32_t hold_ms, uint8_t min_frames) {
+    d->hold_ms = hold_ms;
+    d->min_frames = min_frames;
+    debounce_reset(d);
+}
+
+void debounce_reset(Debounce_t *d) {
+    d->frames = 0;
+    d->holding = 0;
+    d->since_ms = 0;
+    d->last_seq = 0;
+    d->primed = 0;
+}
+
+uint8_t debounce_confirmed(const Debounce_t *d, uint32_t frame_ms) {
+    return d->holding && d->frames >= d->min_frames
+        && (frame_ms - d->since_ms) >= d->hold_ms;
+}
+
+uint8_t debounce_update(Debounce_t *d, uint8_t cond, uint32_t seq, uint32_t frame_ms) {
+    if (d->primed && seq == d->last_seq) {
+        return debounce_confirmed(d, frame_ms); // 不是新帧
+    }
+    d->primed = 1;
+    d->last_seq = seq;
+
+    if (!cond) {
+        d->holding = 0;
+        d->frames = 0;
+        return 0;
+    }
+    if (!d->holding) {
+        d->holding = 1;
+        d->since_ms = frame_ms;
+        d->frames = 0;
+    }
+    if (d->frames < 0xFF) d->frames++;
+    return debounce_confirmed(d, frame_ms);
+}
+
+uint32_t debounce_held_ms(const Debounce_t *d, uint32_t frame_ms) {
+    return d->holding ? (frame_ms - d->since_ms) : 0;
+}
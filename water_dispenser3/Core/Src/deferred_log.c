@@ -0,0 +1,47 @@
+#include "deferred_log.h"
+#include "telemetry.h"
+#include "dwt_timer.h"
+
+static DlogStats_t stats;
+
+uint16_t dlog_encode(const char *fmt, uint16_t str_mask, uint8_t nargs, const uintptr_t *args, uint8_t *out) {
+    // 编号 = 格式串在 .log_fmt 段内的地址（段基址为 0），格式串本身不在 Flash 中
+    uint16_t id = (uint16_t)(uintptr_t)fmt;
+    uint16_t o = 0;
+    out[o++] = (uint8_t)id;
+    out[o++] = (uint8_t)(id >> 8);
+
+    for (uint8_t i = 0; i < nargs && i < DLOG_MAX_ARGS; i++) {
+        if (str_mask & (1U << i)) {
+            if (o + 1 > TLM_MAX_PAYLOAD) break;
+            const char *s = (const char *)args[i];
+            uint16_t room = (uint16_t)(TLM_MAX_PAYLOAD - o - 1);
+            uint16_t n = 0;
+            while (s && n < room && n < 255 && s[n]) n++;
+            out[o++] = (uint8_t)n;
+            for (uint16_t k = 0; k < n; k++) out[o++] = (uint8_t)s[k];
+        } else {
+            if (o + 4 > TLM_MAX_PAYLOAD) break; // 上位机按格式串检测截断
+            uint32_t w = (uint32_t)args[i];
+            out[o++] = (uint8_t)w;
+            out[o++] = (uint8_t)(w >> 8);
+            out[o++] = (uint8_t)(w >> 16);
+            out[o++] = (uint8_t)(w >> 24);
+        }
+    }
+    return o;
+}
+
+void dlog_write(const char *fmt, uint16_t str_mask, uint8_t nargs, const uintptr_t *args) {
+    uint8_t payload[TLM_MAX_PAYLOAD];
+    uint32_t t0 = dwt_cycles();
+    uint16_t n = dlog_encode(fmt, str_mask, nargs, args, payload);
+    stats.enc_cyc += dwt_cycles() - t0;
+    stats.records++;
+    stats.bytes += n;
+    tlm_send(TLM_T_LOG, payload, n);
+}
+
+const DlogStats_t *dlog_stats(void) {
+    return &stats;
+}
@@ -0,0 +1,217 @@
+#include "fast_cutoff.h"
+#include "dwt_timer.h"
+#include "hampel.h"
+#include <stddef.h>
+
+// 逐字节解析状态
+typedef enum {
+    SCAN_IDLE = 0,   // 等待 'a'/'b'/'s'
+    SCAN_KEY,        // 已见 key 字母，等待 ':'
+    SCAN_A,          // 读取 a 数字
+    SCAN_B           // 读取 b 数字
+} ScanState_e;
+
+static void (*pump_off_fn)(void) = NULL;
+
+// 主循环写、中断读的停泵条件
+static volatile uint8_t  armed = 0;
+static volatile uint8_t  fired = 0;
+static volatile uint8_t  cut_fresh = 0;     // 门限已按最近一帧更新，下一帧可用
+static volatile int16_t  cut_a_max = 0;
+static volatile int16_t  cut_reject_max = 0;
+static volatile int16_t  cut_b_threshold = 0;
+static volatile uint8_t  cut_require_strong = 0;
+static volatile uint8_t  cut_confirm_max = 2;
+
+// 取杯保护：MEASURE 全程有效（不受降敏期影响）
+static volatile uint8_t  guarded = 0;
+static volatile uint8_t  removed = 0;
+static volatile int16_t  guard_far = 0;
+static volatile int16_t  guard_b_lost = 0;
+static volatile uint8_t  guard_lost_frames = 2;
+
+// 中断侧私有状态
+static ScanState_e scan_state = SCAN_IDLE;
+static char     scan_key = 0;
+static int32_t  scan_num = 0;
+static uint8_t  scan_digits = 0;
+static int32_t  frame_a = -1;
+static int32_t  frame_b = -1;
+static uint8_t  confirm = 0;
+static uint8_t  lost_count = 0;
+static volatile uint32_t last_frame_cycles = 0;
+static FastCutoffStats_t stats = { 0, 0xFFFFFFFFU, 0, 0, 0 };
+static FastCutoffStats_t removal_stats = { 0, 0xFFFFFFFFU, 0, 0, 0 };
+static Hampel_t gate;           // 与主循环相同的离群点门限（独立实例）
+
+void fast_cutoff_init(void (*pump_off)(void)) {
+    pump_off_fn = pump_off;
+    dwt_init();
+}
+
+static int16_t clamp16(int v) {
+    if (v > 32767) return 32767;
+    if (v < -32768) return -32768;
+    return (int16_t)v;
+}
+
+void fast_cutoff_arm(int a_max, int reject_max, int b_threshold, uint8_t require_strong,
+                     uint8_t confirm_max) {
+    cut_a_max = clamp16(a_max);
+    cut_reject_max = clamp16(reject_max);
+    cut_b_threshold = (int16_t)b_threshold;
+    cut_require_strong = require_strong;
+    cut_confirm_max = confirm_max;
+    cut_fresh = 1;
+    armed = 1;
+}
+
+void fast_cutoff_guard(int far_distance, int b_lost, uint8_t lost_frames) {
+    guard_far = (int16_t)far_distance;
+    guard_b_lost = (int16_t)b_lost;
+    guard_lost_frames = lost_frames ? lost_frames : 1;
+    lost_count = 0;
+    removed = 0;
+    guarded = 1;
+}
+
+void fast_cutoff_disarm(void) {
+    armed = 0;
+    cut_fresh = 0;
+    fired = 0;
+    guarded = 0;
+    removed = 0;
+}
+
+uint8_t fast_cutoff_fired(void) {
+    return fired;
+}
+
+uint32_t fast_cutoff_last_frame_cycles(void) {
+    return last_frame_cycles;
+}
+
+uint8_t fast_cutoff_removed(void) {
+    return removed;
+}
+
+const FastCutoffStats_t *fast_cutoff_stats(void) {
+    return &stats;
+}
+
+const FastCutoffStats_t *fast_cutoff_removal_stats(void) {
+    return &removal_stats;
+}
+
+// 记录帧完成到关断的延迟
+static void stats_record(FastCutoffStats_t *st, uint32_t t_frame) {
+    uint32_t dt = dwt_cycles() - t_frame;
+    st->last = dt;
+    if (dt < st->min) st->min = dt;
+    if (dt > st->max) st->max = dt;
+    st->count++;
+}
+
+// 取杯判断：原始 a/b，不经过门限与均值（两次比较，固定开销）
+static uint8_t removal_check(int32_t a, int32_t b) {
+    if (a > guard_far) return FAST_CUTOFF_REMOVED_FAR;
+    if (b < guard_b_lost) {
+        if (++lost_count >= guard_lost_frames) return FAST_CUTOFF_REMOVED_LOST;
+    } else {
+        lost_count = 0;
+    }
+    return 0;
+}
+
+// 一帧 a/b 完成：按主循环推送的门限判断（固定开销）
+static void on_frame(int32_t a, int32_t b, uint32_t t_frame) {
+    last_frame_cycles = t_frame;
+
+    // 杯子被移走：a 跳到杯底之外，Hampel 门限会把它当离群点剔除，必须先于门限判断
+    if (guarded && !removed && !fired) {
+        uint8_t why = removal_check(a, b);
+        if (why) {
+            if (pump_off_fn) pump_off_fn();
+            removed = why;
+            stats_record(&removal_stats, t_frame);
+            return;
+        }
+    }
+
+    // 溅射/壁面回波造成的单帧离群 a 以中位数代替（与主循环同一门限，门限状态每帧都要更新）
+    int out;
+    uint8_t accepted = hampel_filter(&gate, (int)a, &out);
+    if (!accepted) stats.rejected++;
+
+    if (!armed || fired) return;
+    if (!cut_fresh) { confirm = 0; return; } // 主循环未按上一帧更新门限：本帧不判断
+    cut_fresh = 0;
+
+    uint8_t cond = (out < (accepted ? cut_a_max : cut_reject_max));
+    if (cut_require_strong) cond = cond && (b > cut_b_threshold);
+
+    if (!cond) { confirm = 0; return; }
+    if (++confirm < cut_confirm_max) return;
+
+    // 立即关断，其余工作交给主循环
+    if (pump_off_fn) pump_off_fn();
+    fired = 1;
+    confirm = 0;
+    stats_record(&stats, t_frame);
+}
+
+void fast_cutoff_feed(const uint8_t *ring, uint16_t ring_size, uint16_t from, uint16_t to) {
+    uint32_t t_entry = dwt_cycles();
+
+    while (from != to) {
+        char c = (char)ring[from];
+        from++;
+        if (from >= ring_size) from = 0;
+
+        switch (scan_state) {
+        case SCAN_IDLE:
+            if (c == 'a' || c == 'b' || c == 's') {
+                scan_key = c;
+                scan_state = SCAN_KEY;
+            }
+            break;
+
+        case SCAN_KEY:
+            if (c == ':') {
+                scan_num = 0;
+                scan_digits = 0;
+                if (scan_key == 'a') { frame_a = -1; frame_b = -1; scan_state = SCAN_A; }
+                else if (scan_key == 'b') scan_state = SCAN_B;
+                else {
+                    // s 行开始：a/b 已完整，一帧完成；其后约 1KB 波形数据不再逐字节扫描
+                    scan_state = SCAN_IDLE;
+                    if (frame_a >= 0 && frame_b >= 0) {
+                        int32_t fa = frame_a, fb = frame_b;
+                        frame_a = -1;
+                        frame_b = -1;
+                        on_frame(fa, fb, t_entry);
+                        return;
+                    }
+                }
+            } else {
+                scan_state = SCAN_IDLE;
+            }
+            break;
+
+        case SCAN_A:
+        case SCAN_B:
+            if (c >= '0' && c <= '9' && scan_digits < 6) {
+                scan_num = scan_num * 10 + (c - '0');
+                scan_digits++;
+            } else {
+                if (scan_digits > 0) {
+                    if (scan_state == SCAN_A) frame_a = scan_num;
+                    else frame_b = scan_num;
+                }
+                scan_state = SCAN_IDLE;
+                if (c == 'b' || c == 's') { scan_key = c; scan_state = SCAN_KEY; }
+            }
+            break;
+        }
+    }
+}
@@ -0,0 +1,39 @@
+#include "fill_rate.h"
+#include <string.h>
+
+void fill_rate_reset(FillRate_t *fr) {
+    memset(fr, 0, sizeof(FillRate_t));
+}
+
+void fill_rate_push(FillRate_t *fr, int a, uint32_t t_ms) {
+    fr->a[fr->pos] = (int16_t)a;
+    fr->t[fr->pos] = t_ms;
+    fr->pos++;
+    if (fr->pos >= FILL_RATE_WINDOW) fr->pos = 0;
+    if (fr->count < FILL_RATE_WINDOW) fr->count++;
+}
+
+uint8_t fill_rate_slope(const FillRate_t *fr, int32_t *slope_per_s) {
+    if (fr->count < FILL_RATE_MIN_PTS) return 0;
+
+    // 以最旧样本为时间原点，避免大数相乘
+    uint8_t oldest = (fr->count < FILL_RATE_WINDOW) ? 0 : fr->pos;
+    uint32_t t0 = fr->t[oldest];
+
+    int64_t n = fr->count;
+    int64_t st = 0, sa = 0, stt = 0, sta = 0;
+    for (uint8_t i = 0; i < fr->count; i++) {
+        int64_t t = (int64_t)(fr->t[i] - t0);
+        int64_t a = fr->a[i];
+        st += t;
+        sa += a;
+        stt += t * t;
+        sta += t * a;
+    }
+
+    // slope = (n*Σta - Σt*Σa) / (n*Σt² - (Σt)²)，单位：距离/ms，放大 1000 变为 距离/s
+    int64_t den = n * stt - st * st;
+    if (den <= 0) return 0;
+    *slope_per_s = (int32_t)(((n * sta - st * sa) * 1000) / den);
+    return 1;
+}
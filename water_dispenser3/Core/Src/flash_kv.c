@@ -0,0 +1,258 @@
+#include "flash_kv.h"
+#include "stm32f1xx_hal.h"
+#include <string.h>
+
+// 页头（半字）
+#define HDR_ERASE    0     // 累计擦除次数（擦除后立即写入）
+#define HDR_GEN      2     // 代数：每次压缩 +1
+#define HDR_COPIED   4     // 0x0000=搬运完成，本页有效
+#define HDR_SIZE     8
+
+#define REC_HDR      4     // key + len
+#define REC_CRC      2
+#define HW_FREE      0xFFFFU
+
+static const uint32_t page_addr[2] = { KV_PAGE_A, KV_PAGE_B };
+static uint8_t  active = 0;
+static uint16_t tail = HDR_SIZE;              // 下一条记录的页内偏移
+static uint16_t index_off[KV_MAX_KEYS];       // 键 -> 最新记录的页内偏移（0=不存在）
+static KvStats_t stats;
+
+static inline uint16_t rd16(uint32_t addr) {
+    return *(volatile const uint16_t *)(uintptr_t)addr;
+}
+
+static inline uint16_t rec_size(uint16_t len) {
+    return (uint16_t)(REC_HDR + ((len + 1U) & ~1U) + REC_CRC);
+}
+
+// CRC-16/CCITT-FALSE
+static uint16_t crc16(uint16_t crc, const uint8_t *p, uint16_t n) {
+    while (n--) {
+        crc ^= (uint16_t)(*p++) << 8;
+        for (uint8_t i = 0; i < 8; i++) {
+            crc = (crc & 0x8000U) ? (uint16_t)((crc << 1) ^ 0x1021U) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static uint16_t rec_crc(uint16_t key, uint16_t len, const uint8_t *data) {
+    uint8_t hdr[4] = { (uint8_t)key, (uint8_t)(key >> 8), (uint8_t)len, (uint8_t)(len >> 8) };
+    return crc16(crc16(0xFFFFU, hdr, 4), data, len);
+}
+
+static KvStatus prog16(uint32_t addr, uint16_t v) {
+    return (HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, addr, v) == HAL_OK) ? KV_OK : KV_ERR_FLASH;
+}
+
+// 擦除一页并写回累计擦除次数
+static KvStatus erase_page(uint8_t p) {
+    uint32_t base = page_addr[p];
+    uint16_t cnt = rd16(base + HDR_ERASE);
+    cnt = (cnt == HW_FREE) ? 1 : (uint16_t)(cnt < 0xFFFEU ? cnt + 1 : cnt);
+
+    FLASH_EraseInitTypeDef er = { 0 };
+    uint32_t page_err = 0;
+    er.TypeErase = FLASH_TYPEERASE_PAGES;
+    er.PageAddress = base;
+    er.NbPages = 1;
+    if (HAL_FLASHEx_Erase(&er, &page_err) != HAL_OK) return KV_ERR_FLASH;
+
+    if (p == 0) stats.erase_a = cnt; else stats.erase_b = cnt;
+    return prog16(base + HDR_ERASE, cnt);
+}
+
+// 写一条记录：len -> data -> crc -> key（key 最后写入即提交）
+static KvStatus write_record(uint32_t addr, uint16_t key, const uint8_t *data, uint16_t len) {
+    if (prog16(addr + 2, len) != KV_OK) return KV_ERR_FLASH;
+    for (uint16_t i = 0; i < len; i += 2) {
+        uint16_t hw = data[i] | (uint16_t)(((i + 1U < len) ? data[i + 1] : 0xFFU) << 8);
+        if (prog16(addr + REC_HDR + i, hw) != KV_OK) return KV_ERR_FLASH;
+    }
+    uint32_t crc_addr = addr + rec_size(len) - REC_CRC;
+    if (prog16(crc_addr, rec_crc(key, len, data)) != KV_OK) return KV_ERR_FLASH;
+    if (prog16(addr, key) != KV_OK) return KV_ERR_FLASH;
+    stats.writes++;
+    return KV_OK;
+}
+
+static void count_keys(void) {
+    stats.keys = 0;
+    for (int k = 0; k < KV_MAX_KEYS; k++) {
+        if (index_off[k]) stats.keys++;
+    }
+    stats.used = tail;
+    stats.page = active;
+}
+
+// 扫描当前页：建立索引并找到末尾
+static void scan(void) {
+    uint32_t base = page_addr[active];
+    uint16_t off = HDR_SIZE;
+
+    memset(index_off, 0, sizeof(index_off));
+    while ((uint32_t)off + REC_HDR + REC_CRC <= KV_PAGE_SIZE) {
+        uint16_t key = rd16(base + off);
+        uint16_t len = rd16(base + off + 2);
+        if (key == HW_FREE && len == HW_FREE) break; // 空闲区
+
+        if (len > KV_MAX_VALUE || off + rec_size(len) > KV_PAGE_SIZE) {
+            // 长度损坏，无法定位后续记录：本页余下部分不再使用，下次写入时压缩
+            stats.torn++;
+            off = KV_PAGE_SIZE;
+            break;
+        }
+        const uint8_t *data = (const uint8_t *)(uintptr_t)(base + off + REC_HDR);
+        uint16_t crc = rd16(base + off + rec_size(len) - REC_CRC);
+        if (key < KV_MAX_KEYS && crc == rec_crc(key, len, data)) {
+            index_off[key] = off;
+        } else {
+            stats.torn++; // 未提交（key 未写）或内容损坏
+        }
+        off += rec_size(len);
+    }
+    tail = off;
+    count_keys();
+}
+
+// 把每个键的最新记录搬到另一页，key 直接写入新值；新值在 copied 提交之前写入，
+// 任一步掉电都不会丢失该键（新页未提交时旧页仍有效）
+// 新值放不下时搬运旧值并返回 KV_ERR_FULL
+static KvStatus compact(uint16_t key, const uint8_t *buf, uint16_t len) {
+    uint8_t src = active, dst = (uint8_t)(1 - active);
+    uint32_t sbase = page_addr[src], dbase = page_addr[dst];
+    uint16_t old = index_off[key];
+    KvStatus st = KV_OK;
+
+    if (erase_page(dst) != KV_OK) return KV_ERR_FLASH;
+    uint16_t gen = (uint16_t)(rd16(sbase + HDR_GEN) + 1U);
+    if (gen == HW_FREE) gen = 0;
+    if (prog16(dbase + HDR_GEN, gen) != KV_OK) return KV_ERR_FLASH;
+
+    uint16_t off = HDR_SIZE;
+    for (uint16_t k = 0; k < KV_MAX_KEYS; k++) {
+        uint16_t so = index_off[k];
+        if (!so || k == key) continue;
+        uint16_t n = rd16(sbase + so + 2);
+        if (write_record(dbase + off, k, (const uint8_t *)(uintptr_t)(sbase + so + REC_HDR), n) != KV_OK) return KV_ERR_FLASH;
+        index_off[k] = off;
+        off += rec_size(n);
+    }
+
+    if (off + rec_size(len) <= KV_PAGE_SIZE) {
+        if (write_record(dbase + off, key, buf, len) != KV_OK) return KV_ERR_FLASH;
+        index_off[key] = off;
+        off += rec_size(len);
+    } else {
+        st = KV_ERR_FULL;
+        if (old) {
+            uint16_t n = rd16(sbase + old + 2);
+            if (write_record(dbase + off, key, (const uint8_t *)(uintptr_t)(sbase + old + REC_HDR), n) != KV_OK) return KV_ERR_FLASH;
+            index_off[key] = off;
+            off += rec_size(n);
+        }
+    }
+
+    if (prog16(dbase + HDR_COPIED, 0) != KV_OK) return KV_ERR_FLASH;
+    active = dst;
+    tail = off;
+    stats.compactions++;
+    (void)erase_page(src); // 擦除失败也不影响：两页都有效时启动取 gen 较新的一页
+    return st;
+}
+
+// 格式化：A 页作为空的有效页
+static KvStatus format(void) {
+    if (erase_page(0) != KV_OK) return KV_ERR_FLASH;
+    if (prog16(page_addr[0] + HDR_GEN, 0) != KV_OK) return KV_ERR_FLASH;
+    if (prog16(page_addr[0] + HDR_COPIED, 0) != KV_OK) return KV_ERR_FLASH;
+    if (rd16(page_addr[1] + HDR_GEN) != HW_FREE) return erase_page(1);
+    return KV_OK;
+}
+
+KvStatus kv_init(void) {
+    KvStatus st = KV_OK;
+    uint8_t valid[2];
+    uint16_t gen[2];
+
+    memset(&stats, 0, sizeof(stats));
+    for (uint8_t p = 0; p < 2; p++) {
+        uint16_t e = rd16(page_addr[p] + HDR_ERASE);
+        gen[p] = rd16(page_addr[p] + HDR_GEN);
+        valid[p] = (gen[p] != HW_FREE) && (rd16(page_addr[p] + HDR_COPIED) == 0);
+        if (p == 0) stats.erase_a = (e == HW_FREE) ? 0 : e;
+        else stats.erase_b = (e == HW_FREE) ? 0 : e;
+    }
+
+    HAL_FLASH_Unlock();
+    if (valid[0] && valid[1]) {
+        // 压缩后擦除旧页时掉电：保留较新的一页
+        active = ((int16_t)(gen[1] - gen[0]) > 0) ? 1 : 0;
+        st = erase_page((uint8_t)(1 - active));
+    } else if (valid[0] || valid[1]) {
+        active = valid[0] ? 0 : 1;
+        uint8_t other = (uint8_t)(1 - active);
+        if (gen[other] != HW_FREE) st = erase_page(other); // 搬运未完成的页
+    } else {
+        active = 0;
+        st = format();
+    }
+    HAL_FLASH_Lock();
+
+    scan();
+    return st;
+}
+
+KvStatus kv_get(uint16_t key, void *buf, uint16_t *len) {
+    if (key >= KV_MAX_KEYS) return KV_ERR_KEY;
+    uint16_t off = index_off[key];
+    if (!off) return KV_ERR_NOTFOUND;
+
+    uint32_t addr = page_addr[active] + off;
+    uint16_t n = rd16(addr + 2);
+    if (n > *len) return KV_ERR_LEN;
+    memcpy(buf, (const void *)(uintptr_t)(addr + REC_HDR), n);
+    *len = n;
+    return KV_OK;
+}
+
+KvStatus kv_put(uint16_t key, const void *buf, uint16_t len) {
+    if (key >= KV_MAX_KEYS) return KV_ERR_KEY;
+    if (len > KV_MAX_VALUE) return KV_ERR_LEN;
+
+    // 与已存值相同：不写，减少磨损
+    uint16_t off = index_off[key];
+    if (off) {
+        uint32_t addr = page_addr[active] + off;
+        if (rd16(addr + 2) == len && memcmp((const void *)(uintptr_t)(addr + REC_HDR), buf, len) == 0) {
+            stats.skipped++;
+            return KV_OK;
+        }
+    }
+
+    KvStatus st = KV_OK;
+    uint16_t need = rec_size(len);
+    HAL_FLASH_Unlock();
+    if (tail + need > KV_PAGE_SIZE) {
+        st = compact(key, (const uint8_t *)buf, len); // 新值随压缩一起写入
+    } else {
+        st = write_record(page_addr[active] + tail, key, (const uint8_t *)buf, len);
+        if (st == KV_OK) {
+            index_off[key] = tail;
+            tail += need;
+        }
+    }
+    HAL_FLASH_Lock();
+
+    if (st != KV_OK) {
+        scan(); // 按 Flash 实际内容重建索引，半写的记录在扫描中被跳过
+    } else {
+        count_keys();
+    }
+    return st;
+}
+
+const KvStats_t *kv_stats(void) {
+    return &stats;
+}
@@ -0,0 +1,44 @@
+#include "flow_control.h"
+#include <string.h>
+
+uint16_t flow_ctrl_start(FlowCtrl_t *fc, uint32_t now_ms) {
+    memset(fc, 0, sizeof(FlowCtrl_t));
+    fc->duty = FLOW_DUTY_START;
+    fc->start_ms = now_ms;
+    fc->last_ms = now_ms;
+    return fc->duty;
+}
+
+uint16_t flow_ctrl_update(FlowCtrl_t *fc, int remaining, uint32_t now_ms) {
+    uint32_t elapsed = now_ms - fc->start_ms;
+    int32_t target;
+
+    if (remaining >= FLOW_APPROACH_DIST) {
+        target = FLOW_DUTY_MAX;
+    } else if (remaining <= 0) {
+        target = FLOW_DUTY_MIN;
+    } else {
+        // 接近段：随剩余距离线性降到最低占空
+        target = FLOW_DUTY_MIN + ((int32_t)(FLOW_DUTY_MAX - FLOW_DUTY_MIN) * remaining) / FLOW_APPROACH_DIST;
+    }
+
+    // 软启动：占空上限随时间从初值爬升到满速
+    if (elapsed < FLOW_SOFTSTART_MS) {
+        int32_t cap = FLOW_DUTY_START + ((int32_t)(FLOW_DUTY_MAX - FLOW_DUTY_START) * (int32_t)elapsed) / FLOW_SOFTSTART_MS;
+        if (target > cap) target = cap;
+    }
+
+    // 限制每帧变化量，避免水泵转速突变
+    int32_t diff = target - fc->duty;
+    if (diff > FLOW_SLEW_PER_FRAME) diff = FLOW_SLEW_PER_FRAME;
+    if (diff < -FLOW_SLEW_PER_FRAME) diff = -FLOW_SLEW_PER_FRAME;
+
+    // 统计：满速时长与平均占空
+    if (fc->duty >= FLOW_DUTY_MAX) fc->full_ms += now_ms - fc->last_ms;
+    fc->last_ms = now_ms;
+
+    fc->duty = (uint16_t)(fc->duty + diff);
+    fc->duty_sum += fc->duty;
+    fc->frames++;
+    return fc->duty;
+}
@@ -0,0 +1,82 @@
+#include "hampel.h"
+#include <string.h>
+
+void hampel_reset(Hampel_t *h) {
+    memset(h, 0, sizeof(Hampel_t));
+}
+
+// 从有序数组删除一个值（必定存在）
+static void sorted_remove(int16_t *s, uint8_t n, int16_t v) {
+    uint8_t i = 0;
+    while (i < n && s[i] != v) i++;
+    for (; i + 1 < n; i++) s[i] = s[i + 1];
+}
+
+// 插入有序数组（n 为插入前长度）
+static void sorted_insert(int16_t *s, uint8_t n, int16_t v) {
+    uint8_t i = n;
+    while (i > 0 && s[i - 1] > v) {
+        s[i] = s[i - 1];
+        i--;
+    }
+    s[i] = v;
+}
+
+// 有序数组的 MAD：中位数左侧偏差递增（向左走）、右侧偏差递增（向右走），归并取第 n/2 个
+static int16_t sorted_mad(const int16_t *s, uint8_t n, uint8_t mid) {
+    int16_t med = s[mid];
+    int8_t  l = (int8_t)mid - 1;
+    uint8_t r = mid;
+    int16_t dev = 0;
+    for (uint8_t k = 0; k <= n / 2; k++) {
+        int16_t dl = (l >= 0) ? (int16_t)(med - s[l]) : INT16_MAX;
+        int16_t dr = (r < n) ? (int16_t)(s[r] - med) : INT16_MAX;
+        if (dl <= dr) { dev = dl; l--; }
+        else          { dev = dr; r++; }
+    }
+    return dev;
+}
+
+uint8_t hampel_filter(Hampel_t *h, int x, int *out) {
+    int16_t v = (int16_t)x;
+    uint8_t accept = 1;
+    uint8_t off = 0;
+
+    h->total++;
+    if (h->count >= HAMPEL_MIN_COUNT) {
+        uint8_t mid = h->count / 2;
+        h->median = h->sorted[mid];
+        h->mad = sorted_mad(h->sorted, h->count, mid);
+        int32_t lim = (int32_t)HAMPEL_T_Q8 * ((h->mad < HAMPEL_MAD_MIN) ? HAMPEL_MAD_MIN : h->mad);
+        int32_t d = (int32_t)v - h->median;
+        if (d < 0) d = -d;
+        off = (d * 256 > lim);
+        if (off) {
+            // 与上一个同样偏离的样本一致：阶跃，不是单帧离群
+            int32_t dp = (int32_t)v - h->prev_raw;
+            if (dp < 0) dp = -dp;
+            accept = h->prev_off && (dp * 256 <= lim);
+        }
+    }
+    h->prev_raw = v;
+    h->prev_off = off;
+
+    // 原始样本入窗（先删最旧）
+    if (h->count >= HAMPEL_WINDOW) {
+        sorted_remove(h->sorted, h->count, h->ring[h->pos]);
+        h->count--;
+    }
+    sorted_insert(h->sorted, h->count, v);
+    h->count++;
+    h->ring[h->pos] = v;
+    h->pos++;
+    if (h->pos >= HAMPEL_WINDOW) h->pos = 0;
+
+    if (accept) {
+        *out = x;
+        return 1;
+    }
+    h->rejected++;
+    *out = h->median;
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include "kalman_distance.h"
+#include <string.h>
+
+void kalman_dist_reset(KalmanDist_t *kf) {
+    memset(kf, 0, sizeof(KalmanDist_t));
+}
+
+void kalman_dist_reinit(KalmanDist_t *kf) {
+    if (kf->p00 < KF_P_REINIT) kf->p00 = KF_P_REINIT;
+}
+
+// 观测方差：R = R_BASE * B_REF / b
+static int32_t measurement_var(int b) {
+    if (b < 0) return KF_R_BASE * KF_R_UNKNOWN_MUL;
+    if (b < KF_B_MIN) b = KF_B_MIN;
+    if (b > KF_B_MAX) b = KF_B_MAX;
+    return (int32_t)(((int64_t)KF_R_BASE * KF_B_REF) / b);
+}
+
+// P = F P F' + Q，F = [1 dt; 0 1]（dt 以秒计）
+static void predict(KalmanDist_t *kf, uint32_t t_ms) {
+    uint32_t dt = t_ms - kf->last_ms;
+    if (dt > KF_DT_MAX_MS) dt = KF_DT_MAX_MS;
+    kf->last_ms = t_ms;
+
+    kf->d_q += (int32_t)(((int64_t)kf->v_q * dt) / 1000);
+
+    int64_t p01_dt = ((int64_t)kf->p11 * dt) / 1000;
+    kf->p00 = (int32_t)(kf->p00 + ((int64_t)2 * kf->p01 * dt) / 1000 + (p01_dt * dt) / 1000 + KF_Q_D);
+    kf->p01 = (int32_t)(kf->p01 + p01_dt);
+    kf->p11 = (int32_t)(kf->p11 + ((int64_t)KF_Q_V * dt) / 1000);
+}
+
+void kalman_dist_predict(KalmanDist_t *kf, uint32_t t_ms) {
+    if (kf->init) predict(kf, t_ms);
+}
+
+void kalman_dist_update(KalmanDist_t *kf, int a, int b, uint32_t t_ms) {
+    int32_t z = (int32_t)a * KF_Q;
+
+    if (!kf->init) {
+        // 首个观测直接作为初值，速率未知
+        kf->d_q = z;
+        kf->v_q = 0;
+        kf->p00 = KF_P_INIT;
+        kf->p01 = 0;
+        kf->p11 = KF_PV_INIT;
+        kf->innov_q = 0;
+        kf->last_ms = t_ms;
+        kf->init = 1;
+        return;
+    }
+
+    // ---- 预测 ----
+    predict(kf, t_ms);
+    int64_t p00 = kf->p00;
+    int64_t p01 = kf->p01;
+    int64_t p11 = kf->p11;
+
+    // ---- 更新 ----
+    int64_t s = p00 + measurement_var(b);
+    int32_t innov = z - kf->d_q;
+    kf->innov_q = innov;
+
+    // 增益 Q16
+    int64_t k0 = (p00 << 16) / s;
+    int64_t k1 = (p01 << 16) / s;
+
+    kf->d_q += (int32_t)((k0 * innov) >> 16);
+    kf->v_q += (int32_t)((k1 * innov) >> 16);
+
+    // P = (I - K H) P
+    kf->p00 = (int32_t)(p00 - ((k0 * p00) >> 16));
+    kf->p01 = (int32_t)(p01 - ((k0 * p01) >> 16));
+    kf->p11 = (int32_t)(p11 - ((k1 * p01) >> 16));
+}
+
+// 向上取整除法（den > 0）
+static int64_t div_ceil(int64_t num, int64_t den) {
+    return (num >= 0) ? (num + den - 1) / den : -((-num) / den);
+}
+
+int kalman_dist_stop_threshold(const KalmanDist_t *kf, int d_stop, int b, uint32_t t_ms, uint8_t *pred_below) {
+    // kalman_dist_distance() 四舍五入：估计 < d_stop 等价于 d_q < d_stop*Q - Q/2
+    int32_t stop_q = (int32_t)d_stop * KF_Q - KF_Q / 2;
+
+    if (!kf->init) {
+        *pred_below = 0;
+        return d_stop;  // 首个观测直接作为估计
+    }
+
+    KalmanDist_t tmp = *kf;
+    predict(&tmp, t_ms);
+    *pred_below = (tmp.d_q < stop_q);
+
+    int64_t s = (int64_t)tmp.p00 + measurement_var(b);
+    int64_t k0 = ((int64_t)tmp.p00 << 16) / s;
+    if (k0 <= 0) return *pred_below ? 32767 : -32768; // 观测不影响估计
+
+    // d' = d_pred + (k0 * (a*Q - d_pred)) >> 16 < stop_q
+    //   <=> a < (d_pred*k0 + (stop_q - d_pred) << 16) / (k0*Q)
+    int64_t num = (int64_t)tmp.d_q * k0 + ((int64_t)(stop_q - tmp.d_q) << 16);
+    int64_t a_max = div_ceil(num, k0 * KF_Q);
+    if (a_max > 32767) a_max = 32767;
+    if (a_max < -32768) a_max = -32768;
+    return (int)a_max;
+}
@@ -0,0 +1,53 @@
+#include "ma_bank.h"
+#include <string.h>
+
+static const uint8_t tap_window[MA_BANK_TAPS] = MA_BANK_WINDOWS;
+
+void ma_bank_reset(MaBank_t *mb) {
+    memset(mb, 0, sizeof(MaBank_t));
+}
+
+void ma_bank_push(MaBank_t *mb, int a) {
+    for (uint8_t t = 0; t < MA_BANK_TAPS; t++) {
+        uint8_t w = tap_window[t];
+        if (mb->count >= w) {
+            // 移出该窗口最旧的样本：位于写指针之前 w 个位置
+            uint8_t old = (uint8_t)((mb->pos + MA_BANK_HIST - w) % MA_BANK_HIST);
+            mb->sum[t] -= mb->hist[old];
+        }
+        mb->sum[t] += a;
+    }
+    mb->hist[mb->pos] = (int16_t)a;
+    mb->pos = (uint8_t)((mb->pos + 1) % MA_BANK_HIST);
+    if (mb->count < MA_BANK_HIST) mb->count++;
+}
+
+uint8_t ma_bank_tap(uint16_t window) {
+    for (uint8_t t = 0; t < MA_BANK_TAPS; t++) {
+        if (tap_window[t] >= window) return t;
+    }
+    return MA_BANK_TAPS - 1;
+}
+
+uint8_t ma_bank_window(uint8_t tap) {
+    return tap_window[(tap < MA_BANK_TAPS) ? tap : MA_BANK_TAPS - 1];
+}
+
+int ma_bank_get(const MaBank_t *mb, uint8_t tap) {
+    if (mb->count == 0) return 0;
+    uint8_t w = ma_bank_window(tap);
+    uint8_t n = (mb->count < w) ? mb->count : w;
+    return (int)(mb->sum[tap] / n);
+}
+
+uint8_t ma_bank_ready(const MaBank_t *mb, uint8_t tap) {
+    return mb->count >= ma_bank_window(tap);
+}
+
+int ma_bank_stop_threshold(const MaBank_t *mb, uint8_t tap, int target) {
+    uint8_t w = ma_bank_window(tap);
+    // 下一次 push 移出的样本
+    uint8_t old = (uint8_t)((mb->pos + MA_BANK_HIST - w) % MA_BANK_HIST);
+    int32_t rest = mb->sum[tap] - mb->hist[old];
+    return (int)((int32_t)target * w - rest);
+}
@@ -32,6 +32,30 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include "ultrasonic_threshold.h"
+#include "fill_rate.h"
+#include "flow_control.h"
+#include "fast_cutoff.h"
+#include "dwt_timer.h"
+#include "scheduler.h"
+#include "spsc_queue.h"
+#include "debounce.h"
+#include "cup_sprt.h"
+#include "cup_cache.h"
+#include "flash_kv.h"
+#include "warm_boot.h"
+#include "blackbox.h"
+#include "telemetry.h"
+#include "deferred_log.h"
+#include "kalman_distance.h"
+#include "hampel.h"
+#include "ma_bank.h"
+#include "app_rtos.h"
+#if USE_FREERTOS
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+#endif
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -40,9 +64,27 @@
 // 在这里设置开关： 1 = PWM模式, 0 = GPIO模式
 #define USE_PWM_MODE 1
 
+// 1 = 在串口空闲中断（帧完成处）做快速停泵判断并立即关断 TIM3，0 = 仅主循环判断
+#define USE_FAST_CUTOFF 1
+
+// 1 = 按剩余距离闭环调节 PWM 占空（仅 PWM 模式有效），0 = 固定占空
+#define USE_FLOW_CONTROL 1
+
 // 水泵启停函数
 void pump_start(void);
 void pump_stop(void);
+void pump_set_duty(uint16_t ccr);
+static void pump_off_isr(void);
+
+// 直接写寄存器关断水泵（任何上下文可用，不依赖HAL句柄状态）
+static inline void pump_hw_off(void)
+{
+#if (USE_PWM_MODE == 1)
+  TIM3->CCER &= ~TIM_CCER_CC3E;
+#else
+  GPIOB->BRR = GPIO_PIN_0;
+#endif
+}
 
 
 /* USER CODE END PTD */
@@ -63,13 +105,31 @@ void pump_stop(void);
 
 /* -------- 调试和测试开关 -------- */
 #define DEBUG_ENABLE 1       // 调试输出开关
+#define USE_DEFERRED_LOG 1   // 1=DEBUG_PRINT 只发格式串编号与参数，由上位机还原文本（需 USE_BINARY_TELEMETRY）
 #define TEST_MODE_ENABLE 0   // 测试模式（上位机测试时设为1）
 
 // [新增] 无解析超时复位配置
 #define NO_PARSE_RESET_MS            10000  // 10秒未成功解析则执行恢复
 #define USE_HARD_RESET_ON_NO_PARSE   1      // 1=整机复位(NVIC_SystemReset)，0=仅复位传感器
 
-#if DEBUG_ENABLE
+/* -------- 周期任务（协作式调度） -------- */
+#define INGEST_PERIOD_MS    50     // DMA数据处理周期
+#define AT_POLL_MS          5      // AT序列进行中轮询OK的周期
+#define PARSE_STALE_MS      2000   // 解析缓冲区多久无成功解析则清空
+#define BOOT_DELAY_MS       100    // 上电后等待传感器就绪（热启动跳过）
+#define SCHED_REPORT_MS     60000  // 任务运行时间统计打印周期（0=关闭）
+
+/* -------- 空闲休眠与CPU占用统计 -------- */
+#define USE_WFI_IDLE        1      // 1=空闲时 __WFI() 休眠，0=空转等待
+#if !USE_FREERTOS
+#define CPU_REPORT_MS       10000  // CPU占用打印周期（0=关闭）；须小于DWT回绕时间（72MHz约59秒）
+#else
+#define CPU_REPORT_MS       0      // RTOS 构建中主循环不运行，空闲由内核空闲任务负责
+#endif
+
+#if DEBUG_ENABLE && USE_DEFERRED_LOG
+  #define DEBUG_PRINT(fmt, ...) DLOG(fmt, ##__VA_ARGS__)
+#elif DEBUG_ENABLE
   #define DEBUG_PRINT(fmt, ...) debug_printf(fmt, ##__VA_ARGS__)
 #else
   #define DEBUG_PRINT(fmt, ...) ((void)0)
@@ -85,7 +145,7 @@ static uint32_t last_parse_ok_ms = 0;
 
 /* -------- 解析缓冲区 -------- */
 #define PARSE_BUF_SIZE 2048
-static uint8_t parse_buf[PARSE_BUF_SIZE];
+static uint8_t parse_buf[PARSE_BUF_SIZE + 1]; // 末尾留 1 字节：解析时原地补 '\0'
 static uint16_t parse_len = 0;
 
 /* -------- 数据结构 -------- */
@@ -94,22 +154,38 @@ static uint16_t parse_len = 0;
 typedef struct {
   int a;
   int b;
-  int s[S_COUNT];
+  int16_t s[S_COUNT];   // 与阈值算法/液位跟踪的输入类型一致，直接传入无需拷贝
   bool valid;
 } SensorFrame;
 
 static SensorFrame current_frame;
 
-/* -------- 移动平均 -------- */
-#define MAX_MA_WINDOW 16
-static int a_hist[MAX_MA_WINDOW];
-static uint32_t a_sum = 0;
-static uint16_t a_hist_count = 0;
-static uint16_t a_hist_pos = 0;
+// ingest_parse 的结果（位标志）
+enum {
+  INGEST_NONE     = 0,
+  INGEST_FULL     = 1u << 0,  // 完整帧（a/b/s）
+  INGEST_A_ONLY   = 1u << 1,  // 整帧解析失败，但得到了新的 a
+  INGEST_OVERFLOW = 1u << 2   // 解析缓冲过满已清空
+};
+static int ingest_last_a = 0;   // 解析侧最近的 a（用于判断“仅 a 变化”）
+
+/* -------- 移动平均（多速率：3/8/16 同时维护，状态只选择输出） -------- */
+static MaBank_t a_bank;
+static uint8_t a_ma_tap = MA_BANK_TAPS - 1; // 当前状态选用的抽头
 static int a_filtered = 0;
+
+/* -------- 距离卡尔曼滤波（替代 a_filtered 的滑动平均） -------- */
+#define USE_KALMAN_DISTANCE 1      // 1=a_filtered 取卡尔曼估计，0=滑动平均（旧逻辑）
+static KalmanDist_t a_kf;          // 跨状态保留，不随状态切换清零
+
+/* -------- 离群点门限（滤波之前） -------- */
+#define USE_HAMPEL_GATE 1          // 1=Hampel 剔除单帧离群 a，0=不剔除
+static Hampel_t a_hampel;
+static bool a_rejected = false;    // 最近一帧 a 被门限剔除（卡尔曼只做了预测，新息是旧值）
 static uint16_t a_ma_window = 16;
 static int last_a=0;
-static bool a_changed = false;
+static uint32_t frame_seq = 0;   // 每得到一个新的 a 递增，用于“每帧一次”的处理
+static uint32_t frame_ts_ms = 0; // 最近一个新 a 的时间戳（确认窗口按帧时间计算）
 // 新增：记录最近一次的 b，以及是否需要强回波校验
 static int last_b = 0;
 static bool require_strong_echo = false;
@@ -120,20 +196,248 @@ typedef enum {
   STATE_CONFIGURE,
   STATE_VERIFY,     // <-- [新状态] 阈值验证阶段
   STATE_MEASURE,
-  STATE_WAIT
+  STATE_WAIT,
+  STATE_ABORT,      // 出水中杯子被移走：停泵后的清理状态
+  STATE_COUNT
 } AppState;
 
 static AppState app_state = STATE_DETECT;
 
-/* -------- 状态切换确认机制 -------- */
-#define DETECT_CONFIRM_COUNT_MAX 15
-#define WAIT_CONFIRM_COUNT_MAX 3
-#define MEASURE_CONFIRM_COUNT_MAX 2
-#define MEASURE_GRACE_MS 4000      // 测量阶段进入后的降敏时间窗
-static int state_confirm_count = 0;
-#define VERIFY_COUNT_MAX 8      // <-- [新定义] 验证阶段的连续确认次数
-static int verify_confirm_count = 0; // <-- [新变量] 验证计数器
+/* -------- 事件：主循环只在有待处理事件时运行状态机 -------- */
+typedef enum {
+  EV_FRAME   = 1u << 0,   // 得到新的 a（完整帧或仅 a 变化）
+  EV_TIMER   = 1u << 1,   // 状态定时器到期
+  EV_AT_DONE = 1u << 2,   // AT 命令序列完成
+  EV_FAULT   = 1u << 3    // 故障（无解析看门狗）
+} AppEvent;
+
+static volatile uint32_t ev_pending = 0;   // 主循环内部事件（仅主循环/任务上下文写）
+
+/* 中断 -> 主循环 事件队列。生产者为 USART1 中断及其 DMA 通道中断（同一抢占优先级，互不嵌套），
+ * 消费者为主循环，满足单生产者/单消费者 */
+static SpscQueue_t isr_queue;
+static uint32_t uart_err_count = 0;
+static uint16_t isr_scan_pos = 0;          // 空闲中断扫描到的DMA位置
+
+/* -------- 状态表：每个状态声明进入/退出动作与事件处理 -------- */
+typedef struct {
+  const char *name;
+  void (*on_entry)(uint32_t now);
+  void (*on_exit)(uint32_t now);
+  void (*on_event)(uint32_t ev, uint32_t now);
+} StateDesc;
+
+static uint32_t state_enter_ms = 0;
+static uint32_t state_dwell_ms[STATE_COUNT];   // 各状态累计停留时间
+static uint32_t state_visits[STATE_COUNT];     // 各状态进入次数
+
+/* -------- 调度任务号 -------- */
+#if !USE_FREERTOS                             // RTOS 构建中由 ingest/config 任务负责
+static int8_t job_ingest = SCHED_NO_JOB;      // 周期：DMA数据处理与帧解析
+static int8_t job_at = SCHED_NO_JOB;          // 周期：AT序列轮询（仅序列进行中启动）
+static int8_t job_parse_stale = SCHED_NO_JOB; // 超时：解析缓冲区陈旧清空
+#endif
+static int8_t job_watchdog = SCHED_NO_JOB;    // 超时：无解析看门狗
+static int8_t job_state_timer = SCHED_NO_JOB; // 单次：状态定时器（切换状态时取消）
+static int8_t job_boot = SCHED_NO_JOB;        // 单次：上电延时后启动状态机
+static int8_t job_persist = SCHED_NO_JOB;     // 周期：空闲时把改动写入 Flash
+static int8_t job_console = SCHED_NO_JOB;     // 周期：USART2 控制台命令
+
+/* -------- CPU占用（按状态统计，每个报告周期清零） -------- */
+static uint32_t cpu_active_cyc[STATE_COUNT];
+static uint32_t cpu_sleep_cyc[STATE_COUNT];
+static uint32_t cpu_mark = 0;                 // 上一次记账的DWT时刻
+
+#if USE_FREERTOS
+/* -------- RTOS 任务与队列 -------- */
+typedef struct {
+  uint8_t len;
+  char text[LOG_LINE_LEN];
+} LogLine;
+
+/* 任务之间只通过队列/通知交换数据，不共享锁：
+ *  ingest  -> control : frame_queue（解析好的帧）
+ *  control -> config  : at_cmd_queue（AT 命令），完成后 EV_AT_DONE 通知 control
+ *  任意    -> telemetry: log_queue（USART2 输出）
+ * 解析缓冲/DMA 读指针归 ingest，AT 的 OK 检测读指针与 USART1 发送归 config，其余状态归 control */
+typedef struct {
+  uint8_t     result;          // ingest_parse 的结果标志
+  uint32_t    t_ms;
+  SensorFrame frame;           // ingest_parse 直接写入；s 仅 INGEST_FULL 时有效
+} FrameMsg;
+
+static QueueHandle_t log_queue = NULL;
+static QueueHandle_t frame_queue = NULL;
+static QueueHandle_t at_cmd_queue = NULL;
+static volatile uint8_t at_pending = 0;       // 已入队未完成的 AT 命令数（临界区内修改）
+static volatile uint8_t at_gen = 0;           // at_reset 递增：丢弃进行中的旧命令
+static volatile bool uart_restart_req = false; // USART1 错误：请 ingest 任务重启 DMA 接收
+static uint32_t frame_drop_count = 0;         // frame_queue 满时丢弃的帧数
+static TaskHandle_t task_ingest_h = NULL;
+static TaskHandle_t task_control_h = NULL;
+static TaskHandle_t task_config_h = NULL;
+static TaskHandle_t task_telemetry_h = NULL;
+static uint32_t log_drop_count = 0;           // 日志队列满时丢弃的行数
+#endif
+
+/* -------- AT 命令序列（非阻塞） -------- */
+#define AT_QUEUE_MAX   8
+#define AT_CMD_LEN     24
+typedef struct {
+  char cmd[AT_CMD_LEN];
+  uint16_t timeout_ms;
+} AtCmd;
+#if !USE_FREERTOS                      // RTOS 构建中命令经 at_cmd_queue 交给 config 任务
+static AtCmd at_queue[AT_QUEUE_MAX];
+static uint8_t at_q_len = 0;          // 队列中命令数
+static uint8_t at_q_idx = 0;          // 正在等待 OK 的命令
+static uint32_t at_cmd_start_ms = 0;
+static uint8_t at_fail_count = 0;     // 本序列超时次数
+#endif
+static volatile bool at_busy = false;   // RTOS 构建中由 control 置位、config 清除
+static uint16_t at_ok_pos = 0;        // OK 检测的本地读指针
+static uint8_t at_ok_buf[64];
+static uint16_t at_ok_len = 0;
+static bool at_boot_init_pending = true; // 开机首次进入 DETECT：只发 STOP/DEBUG/REBOOT，不改传感器阈值
+
+/* -------- 状态切换确认机制：条件持续 HOLD_MS 且期间至少 MIN_FRAMES 个新帧 -------- */
+// 时间为主、帧数为辅：帧率变化或丢帧时确认延迟保持不变（按100ms帧间隔与原帧数对齐）
+#define DETECT_HOLD_MS       1400
+#define DETECT_MIN_FRAMES    5
+#define WAIT_HOLD_MS         200
+#define WAIT_MIN_FRAMES      3
+#if USE_HAMPEL_GATE
+// 单帧离群已由 Hampel 门限剔除，停泵只需一个通过门限的新帧；
+// 门限本身让真实阶跃晚 HAMPEL_STEP_LAG 帧被接受，总延迟与原先 2 帧确认相当，计入提前量
+#define MEASURE_HOLD_MS      0
+#define MEASURE_MIN_FRAMES   1     // 中断侧快速停泵同样按该帧数确认（中断侧同样有门限）
+#else
+#define MEASURE_HOLD_MS      50
+#define MEASURE_MIN_FRAMES   2     // 中断侧快速停泵同样按该帧数确认
+#endif
+#define MEASURE_GRACE_MS 4000      // 测量阶段降敏时间窗上限（硬上限，状态定时器）
+
+/* -------- 自适应降敏：溅射瞬态平稳或按杯深提前结束 -------- */
+#define USE_ADAPTIVE_GRACE   1     // 1=自适应提前结束降敏，0=固定 MEASURE_GRACE_MS
+#define GRACE_MIN_MS         800   // 降敏最短时间（起始冲击）
+#define GRACE_MS_PER_DEPTH   25    // 按杯深（距离单位）估算的降敏时间系数
+#define GRACE_SETTLE_FRAMES  3     // 连续平稳帧数
+#define GRACE_INNOV_MAX      6     // 平稳判据：|新息| 不超过该值（距离单位）
+static int cup_depth = 0;              // 杯口到液面/杯底的距离（CONFIGURE 结果）
+static uint8_t grace_settle_count = 0;
+static uint32_t grace_seq = 0;         // 已判断过的帧序号（每帧只计一次）
+static uint32_t armed_sum_ms = 0;      // 各杯降敏时间累计
+static uint32_t armed_cnt = 0;
+
+/* -------- 取杯保护：出水中杯子被移走立即停泵 -------- */
+#define USE_REMOVAL_ABORT    1     // 1=出水期间（MEASURE 及 VERIFY 预先出水）按原始 a/b 检测取杯，0=仅靠 WAIT 阶段发现
+#define REMOVAL_MARGIN       25    // a 超过杯底该距离即视为杯子已移走（距离单位）
+#define REMOVAL_B_LOST_DIV   6     // b < t1/6 视为回波丢失
+#define REMOVAL_LOST_FRAMES  2     // 回波丢失需连续帧数（距离跳变单帧即判定）
+#define ABORT_SETTLE_MS      1000  // 清理状态停留时间：传感器停止、残余水滴落完
+static int removal_distance = 0;       // 本杯的取杯判定距离
+static int removal_b_lost = 0;
+static uint8_t removal_lost_count = 0;
+static uint32_t removal_seq = 0;       // 已判断过的帧序号
+static uint32_t removal_cnt = 0;
+
+/* -------- DETECT：序贯检验（SPRT）判定放杯 -------- */
+#define USE_SPRT_DETECT 0          // 1=按原始 a/b 的序贯检验判定，0=16点均值 + 时间确认（旧逻辑）
+                                   // 待 sprt_replay.py 在录制的空腔/有杯日志上给出误触发率与判定时间后再默认开启
+static CupSprt_t cup_sprt;
+static uint32_t sprt_test_ms = 0;  // 本次检验的首帧时间
+static Debounce_t state_deb;       // 当前状态的切换确认（各状态互斥，共用一个）
+#define VERIFY_HOLD_MS       700   // <-- 验证阶段需连续无突破的时间
+#define VERIFY_MIN_FRAMES    4
+static Debounce_t verify_deb;      // <-- 验证确认
 static uint32_t measure_enter_ms = 0; // 记录进入MEASURE的时间，用于降敏
+static bool measure_armed = false;    // 降敏期结束（状态定时器到期）后置位
+
+/* -------- 置信度分级验证 -------- */
+#define CONF_SKIP_VERIFY   85   // confidence>=该值：跳过VERIFY直接进入MEASURE
+#define CONF_FAST_VERIFY   60   // confidence>=该值：缩短验证
+#define VERIFY_HOLD_FAST_MS     200  // 缩短验证时的确认时间
+#define VERIFY_MIN_FRAMES_FAST  2
+static int verify_count_target = VERIFY_MIN_FRAMES; // 本杯验证至少需要的帧数（0=跳过验证）
+static uint32_t verify_hold_ms = VERIFY_HOLD_MS;    // 本杯验证需持续的时间
+
+/* -------- 杯子指纹缓存：常见杯子复用标定结果 -------- */
+#define USE_CUP_CACHE 1            // 1=指纹命中时复用 x/t1/y/t2/stop_distance 并缩短验证
+static CupCache_t cup_cache;
+static CupSig_t cfg_sig;               // 本杯指纹
+static uint8_t cfg_edge_extension = 0;
+static bool cfg_sig_pending = false;   // 本杯最终参数尚未写入缓存（进入 MEASURE 时写入）
+
+/* -------- 参数持久化：Flash 最后两页的键值存储 -------- */
+#define USE_FLASH_KV   1           // 1=开机恢复、空闲时保存杯子缓存与计数
+#define KV_PERSIST_MS  5000        // 保存检查周期；只在 DETECT（水泵不可能运行）时写 Flash
+enum {
+  KV_KEY_BOOT_COUNT = 0,           // uint32_t 冷启动（上电/外部复位）次数，热复位不计
+  KV_KEY_DISPENSES  = 1,           // uint32_t 累计出水杯数
+  KV_KEY_CUP_BASE   = 8            // 杯子缓存第 i 项：KV_KEY_CUP_BASE + i
+};
+static uint32_t boot_count = 0;
+static uint32_t boot_saved = 0;        // 已写入 Flash 的冷启动次数
+static uint32_t dispense_count = 0;
+static uint32_t dispense_saved = 0;    // 已写入 Flash 的出水杯数
+static uint8_t cup_cache_dirty = 0;    // 位图：待写入的缓存项
+
+/* -------- 热启动：主动复位后跳过重复的传感器初始化 -------- */
+#define USE_WARM_BOOT  1           // 1=复位前写 BKP 快照，热启动时按快照跳过初始化
+#define WARM_PROBE_MS  500         // 跳过初始化后该时间内无解析帧，则补做完整初始化
+static bool warm_skip_init = false;     // 下一次进入 DETECT 不下发默认配置
+static bool sensor_cfg_default = false; // 传感器处于默认配置（DETECT 的 AT 序列已完成）
+static bool sensor_cfg_pending = false; // 进行中的 AT 序列会把传感器恢复为默认配置
+static bool warm_probe = false;         // 跳过初始化后等待首帧（收到即确认传感器仍是默认配置）
+static const char *boot_kind = "cold";
+static uint8_t boot_code = 0;            // 与 boot_kind 对应：0=cold 1=warm 2=warm-skip（遥测 aux）
+static uint32_t boot_first_frame_ms = 0; // 复位到首个解析帧（0=尚未收到）
+
+/* -------- 黑匣子：关键事件记录，故障/复位前写入 Flash -------- */
+#define USE_BLACKBOX     1         // 1=记录事件（可在生产版本中保持开启）
+#define BB_CONSOLE_MS    200       // USART2 控制台命令轮询周期（'B' 导出，'R' 主动复位）
+
+/* -------- USART2 二进制遥测（COBS 成帧，上位机 telemetry_decode.py 解码） -------- */
+#define USE_BINARY_TELEMETRY  1    // 1=帧/状态/阈值/指标按结构体发送，其余文本也装入 COBS 帧；0=纯文本
+#define TLM_REPORT_MS     60000    // 文本与二进制输出的字节数/耗时对比打印周期（0=关闭）
+#define UART2_US_PER_BYTE 87       // 115200 8N1：每字节 10 位
+#if USE_DEFERRED_LOG && !USE_BINARY_TELEMETRY
+#error "USE_DEFERRED_LOG requires USE_BINARY_TELEMETRY"
+#endif
+#if !USE_DEFERRED_LOG
+typedef struct {
+  uint32_t lines;
+  uint32_t bytes;
+  uint32_t fmt_cyc;                // vsnprintf 耗时（DWT 周期）
+} TextStats_t;
+static TextStats_t txt_stats;
+#endif
+
+/* -------- VERIFY 阶段 t1 标定 -------- */
+#define VERIFY_SINGLE_SHOT_CAL 1   // 1=按窗口统计一次性标定t1，0=每次失败即调整并重启（旧逻辑）
+#define VERIFY_CAL_WINDOW      4   // 首次失败起收集的样本数
+#define VERIFY_CAL_MARGIN      50  // 失败样本 b 最大值之上的裕量
+static int verify_win_count = 0;        // 当前窗口已收集样本数（出现失败后才开始计数）
+static int verify_fail_count = 0;       // 当前窗口内失败次数
+static int verify_fail_b_max = 0;       // 当前窗口内失败样本 b 的最大值
+static int verify_reconfig_count = 0;   // 本杯重新配置次数
+static uint32_t verify_enter_ms = 0;    // 进入VERIFY的时间
+static uint8_t last_confidence = 0;
+
+/* -------- VERIFY 期间预先低速出水 -------- */
+#define USE_SPECULATIVE_START 1    // 1=配置结果可信时 VERIFY 一开始就低速启动水泵，验证失败立即停止
+#define SPEC_MIN_CONFIDENCE   40   // confidence>=该值才预先启动
+#define SPEC_DUTY             500  // 预先启动的占空（CCR，Period=999）
+static bool spec_running = false;      // 预先启动的水泵正在运行
+static bool spec_handover = false;     // 验证通过，水泵交给 MEASURE 继续运行
+static uint32_t spec_starts = 0;
+static uint32_t spec_aborts = 0;
+static uint32_t spec_start_ms = 0;     // 预先启动时刻：交给 MEASURE 时才计入首次出水耗时
+
+/* -------- 出水耗时统计（检测确认 -> 首次出水） -------- */
+static uint32_t cup_detect_ms = 0;
+static uint32_t ttd_sum_ms[3] = {0, 0, 0};  // [0]=完整验证, [1]=跳过/缩短验证, [2]=预先启动
+static uint32_t ttd_cnt[3] = {0, 0, 0};
 
 /* -------- 配置参数 -------- */
 static int x_param = 60;
@@ -144,6 +448,36 @@ static int edge_distance = 160;
 static int alarm_distance_check = 0; // 用于VERIFY阶段的距离判断 (x*430/225)
 static int stop_distance = 0;        // MEASURE阶段使用的停止距离
 
+/* -------- 液位回波跟踪（MEASURE 阶段第二路停止信号） -------- */
+#define USE_LIQUID_TRACKER 1   // 1=跟踪波形中的液位峰并参与停止判断
+#define TRACK_AGREE_TOL    15  // 跟踪距离与 a_filtered 相差不超过该值才采信，防止锁到干扰峰
+static LiquidTracker_t liquid_trk;
+
+/* -------- 预测停泵：按注水速率和端到端延迟提前停泵 -------- */
+#define USE_PREDICTIVE_STOP  1     // 1=提前停泵补偿预计过冲，0=仅按 stop_distance 判断
+#define PUMP_SPINDOWN_MS     60    // 水泵关断到断流的时间（实测标定）
+#define POLL_LATENCY_MS      30    // 轮询延迟均值（50ms DMA 处理周期的一半 + 主循环 5ms）
+#define PREDICT_MAX_LEAD     40    // 提前量上限（距离单位），防止速率估计异常
+#define STOP_SETTLE_MS       1500  // 停泵后等待液面平稳再统计误差
+static FillRate_t fill_rate;
+static uint32_t frame_interval_ms = 100; // 帧间隔（一阶平滑，实测）
+static uint32_t last_frame_ms = 0;
+static int stop_lead = 0;                // 本杯停泵时使用的提前量
+
+/* -------- 注水流量控制 -------- */
+static FlowCtrl_t flow_ctrl;
+static uint32_t flow_seq = 0;            // 流量控制器已处理到的帧序号
+
+/* 停泵误差统计：error = stop_distance - 平稳后距离（正值=过冲） */
+#define STOP_ERR_BIN_W      5
+#define STOP_ERR_BINS       9      // 覆盖 [-20, +25)，两端含溢出
+static bool stop_err_pending = false;
+static uint32_t stop_ms = 0;
+static int stop_target = 0;
+static uint16_t stop_err_hist[STOP_ERR_BINS];
+static int32_t stop_err_sum = 0;
+static uint16_t stop_err_cnt = 0;
+
 /* 阈值 */
 #define THRESH_DETECT_STOP   250
 #define THRESH_MEASURE_HIGH  295
@@ -152,7 +486,6 @@ static int stop_distance = 0;        // MEASURE阶段使用的停止距离
 #if TEST_MODE_ENABLE
 static uint32_t test_frame_count = 0;
 static uint32_t test_parse_fail = 0;
-static uint32_t test_last_report = 0;
 #endif
 
 /* -------- 函数声明 -------- */
@@ -160,18 +493,87 @@ static void uart_dma_start(void);
 static uint16_t dma_get_pos(void);
 static void dma_rx_flush(void);
 static void process_dma_data(void);
-static bool parse_sensor_frame(const uint8_t *data, uint16_t len, SensorFrame *frame);
+static bool parse_sensor_frame(uint8_t *data, uint16_t len, SensorFrame *frame);
 static int  find_last_frame_start(const uint8_t *data, uint16_t len);
 static void clear_parse_buffer(void);
-static void update_a_moving_average(int a, uint16_t window);
-static void reset_moving_average(void);
+static void select_a_window(uint16_t window);
+static void update_a_filter(int a, int b, uint32_t t_ms);
 static void send_at(const char *fmt, ...);
-static bool wait_for_ok(uint32_t timeout_ms);
+static void at_enqueue(uint16_t timeout_ms, const char *fmt, ...);
+#if !USE_FREERTOS
+static void at_poll(uint32_t now);
+#endif
+static void at_reset(void);
+static void at_queue_sensor_defaults(void);
+static void at_queue_sensor_init(void);
+#if !USE_DEFERRED_LOG
 static void debug_printf(const char *fmt, ...);
+#endif
+static void uart2_write(const uint8_t *data, uint16_t len);
+static void log_write(const char *text, uint16_t len);
 
 // [新增] 恢复函数声明
-static void system_hard_reset(void);
-static void sensor_soft_recover(void);
+static void system_hard_reset(uint16_t reason);
+static void sensor_soft_recover(uint32_t now);
+
+static void ev_post(uint32_t ev);
+static void isr_post(uint8_t type, uint32_t arg);
+static bool events_pending(void);
+static void drain_isr_events(uint32_t now);
+static void uart_rx_restart(void);
+static uint8_t ingest_parse(SensorFrame *frame);
+static void frame_apply(uint8_t r, uint32_t now);
+#if !USE_FREERTOS
+static void ingest_frames(uint32_t now);
+#endif
+static void fsm_start(uint32_t now);
+static void fsm_transition(AppState next, uint32_t now);
+static void fsm_dispatch(uint32_t now);
+static void state_timer_start(uint32_t now, uint32_t ms);
+static void sched_setup(uint32_t now);
+#if USE_FLASH_KV
+static void kv_restore(void);
+#endif
+#if USE_WARM_BOOT
+static void warm_restore(void);
+#endif
+static void cpu_idle(void);
+#if USE_FREERTOS
+static void app_rtos_start(void);
+#endif
+
+static void detect_entry(uint32_t now);
+static void detect_event(uint32_t ev, uint32_t now);
+static void configure_entry(uint32_t now);
+static void configure_event(uint32_t ev, uint32_t now);
+static void verify_entry(uint32_t now);
+static void verify_event(uint32_t ev, uint32_t now);
+static void verify_exit(uint32_t now);
+static void spec_abort(const char *why);
+static void ttd_record(int path, uint32_t now);
+static void measure_entry(uint32_t now);
+static void measure_exit(uint32_t now);
+static void measure_event(uint32_t ev, uint32_t now);
+static void measure_arm(uint32_t now, const char *why);
+static void wait_entry(uint32_t now);
+static void wait_event(uint32_t ev, uint32_t now);
+static bool removal_check(uint32_t now);
+static void removal_guard_start(void);
+static void abort_entry(uint32_t now);
+static void abort_event(uint32_t ev, uint32_t now);
+
+static int predict_stop_lead(void);
+static void stop_error_record(int settled_a);
+static void verify_apply_t1(void);
+
+static const StateDesc state_table[STATE_COUNT] = {
+  [STATE_DETECT]    = { "DETECT",    detect_entry,    NULL,         detect_event    },
+  [STATE_CONFIGURE] = { "CONFIGURE", configure_entry, NULL,         configure_event },
+  [STATE_VERIFY]    = { "VERIFY",    verify_entry,    verify_exit,  verify_event    },
+  [STATE_MEASURE]   = { "MEASURE",   measure_entry,   measure_exit, measure_event   },
+  [STATE_WAIT]      = { "WAIT",      wait_entry,      NULL,         wait_event      },
+  [STATE_ABORT]     = { "ABORT",     abort_entry,     NULL,         abort_event     },
+};
 
 /* USER CODE END PV */
 
@@ -255,16 +657,15 @@ static int find_last_frame_start(const uint8_t *data, uint16_t len)
 }
 
 /* 严格解析：a/b 仅数字；s 仅 [0-9,] 和 行结束符 */
-static bool parse_sensor_frame(const uint8_t *data, uint16_t len, SensorFrame *frame)
+static bool parse_sensor_frame(uint8_t *data, uint16_t len, SensorFrame *frame)
 {
   if (!data || !frame || len < 50) {
     return false;
   }
 
-  // 转成以0结尾字符串
-  static char str_buf[PARSE_BUF_SIZE + 1];
+  // 转成以0结尾字符串：data 为 parse_buf（末尾留有 1 字节），原地补 '\0'，不再整帧拷贝到静态区
   uint16_t copy_len = (len < PARSE_BUF_SIZE) ? len : PARSE_BUF_SIZE;
-  memcpy(str_buf, data, copy_len);
+  char *str_buf = (char *)data;
   str_buf[copy_len] = '\0';
 
   // 必须从缓冲区起始位置就是一帧的起点 "a:"
@@ -335,36 +736,48 @@ static bool parse_sensor_frame(const uint8_t *data, uint16_t len, SensorFrame *f
   return false;
 }
 
-/* 更新移动平均 */
-static void update_a_moving_average(int a, uint16_t window)
+/* 状态切换时选择均值窗口：各窗口一直在更新，无需清零与预热 */
+static void select_a_window(uint16_t window)
 {
-  if (window > MAX_MA_WINDOW) window = MAX_MA_WINDOW;
-  a_ma_window = window;
-
-  if (a_hist_count < a_ma_window) {
-    a_sum += a;
-    a_hist[a_hist_pos++] = a;
-    if (a_hist_pos >= a_ma_window) a_hist_pos = 0;
-    a_hist_count++;
-  } else {
-    a_sum -= a_hist[a_hist_pos];
-    a_sum += a;
-    a_hist[a_hist_pos] = a;
-    a_hist_pos++;
-    if (a_hist_pos >= a_ma_window) a_hist_pos = 0;
-  }
-
-  a_filtered = (a_hist_count > 0) ? (int)(a_sum / a_hist_count) : a;
+  a_ma_tap = ma_bank_tap(window);
+  a_ma_window = ma_bank_window(a_ma_tap);
+#if USE_KALMAN_DISTANCE
+  // 卡尔曼估计不丢弃：只放大方差，1~2帧内跟上新工况
+  kalman_dist_reinit(&a_kf);
+  a_filtered = a_kf.init ? kalman_dist_distance(&a_kf) : 0;
+#else
+  a_filtered = ma_bank_get(&a_bank, a_ma_tap);
+#endif
 }
 
-/* 重置移动平均 */
-static void reset_moving_average(void)
+/* 新的 a：更新多速率均值与卡尔曼估计
+ * b<0 表示本次只有 a（帧解析失败），观测方差按未知处理 */
+static void update_a_filter(int a, int b, uint32_t t_ms)
 {
-  memset(a_hist, 0, sizeof(a_hist));
-  a_sum = 0;
-  a_hist_count = 0;
-  a_hist_pos = 0;
-  a_filtered = 0;
+  bool accepted = true;
+#if USE_HAMPEL_GATE
+  int raw = a;
+  accepted = hampel_filter(&a_hampel, raw, &a);
+  a_rejected = !accepted;
+  if (!accepted) {
+    DEBUG_PRINT("[HAMPEL] reject a=%d (median=%d, mad=%d), %lu/%lu\r\n", raw, a_hampel.median,
+                a_hampel.mad, (unsigned long)a_hampel.rejected, (unsigned long)a_hampel.total);
+  }
+#endif
+  ma_bank_push(&a_bank, a); // 离群时以中位数计入
+#if USE_KALMAN_DISTANCE
+  if (accepted) {
+    kalman_dist_update(&a_kf, a, b, t_ms);
+  } else {
+    kalman_dist_predict(&a_kf, t_ms); // 离群时不作观测，只按匀速外推
+  }
+  a_filtered = kalman_dist_distance(&a_kf);
+#else
+  (void)accepted;
+  (void)b;
+  (void)t_ms;
+  a_filtered = ma_bank_get(&a_bank, a_ma_tap);
+#endif
 }
 
 /* 发送AT命令 */
@@ -382,68 +795,421 @@ static void send_at(const char *fmt, ...)
   }
 }
 
-/* 等待OK响应（不污染全局 dma_last_pos，成功后统一 flush） */
-static bool wait_for_ok(uint32_t timeout_ms)
+/* 读取 AT 序列开始后新到的字节并查找 "OK"（不移动解析用的 dma_last_pos） */
+static bool at_ok_scan(void)
 {
-  uint32_t start = HAL_GetTick();
-  static uint8_t ok_buf[64];
-  uint16_t ok_len = 0;
-  uint16_t search_start_pos = 0;
+  uint16_t current_pos = dma_get_pos();
+  if (current_pos == at_ok_pos) return false;
 
-  uint16_t ok_last_pos = dma_get_pos(); // 本地读指针
+  uint16_t search_start = (at_ok_len > 1) ? (at_ok_len - 1) : 0;
+  while (at_ok_pos != current_pos && at_ok_len < sizeof(at_ok_buf) - 1) {
+    at_ok_buf[at_ok_len++] = dma_rx_buf[at_ok_pos];
+    at_ok_pos = (uint16_t)((at_ok_pos + 1) % DMA_RX_BUF_SIZE);
+  }
+  at_ok_pos = current_pos;
 
-  while ((HAL_GetTick() - start) < timeout_ms) {
-    uint16_t current_pos = dma_get_pos();
+  // 搜索 "OK"
+  for (uint16_t i = search_start; i + 1 < at_ok_len; i++) {
+    if (at_ok_buf[i] == 'O' && at_ok_buf[i+1] == 'K') return true;
+  }
+  return false;
+}
 
-    if (current_pos != ok_last_pos) {
-      if (current_pos > ok_last_pos) {
-        uint16_t len = current_pos - ok_last_pos;
-        for (uint16_t i = 0; i < len && ok_len < sizeof(ok_buf) - 1; i++) {
-          ok_buf[ok_len++] = dma_rx_buf[ok_last_pos + i];
-        }
-      } else {
-        uint16_t len1 = DMA_RX_BUF_SIZE - ok_last_pos;
-        uint16_t len2 = current_pos;
-        for (uint16_t i = 0; i < len1 && ok_len < sizeof(ok_buf) - 1; i++) {
-          ok_buf[ok_len++] = dma_rx_buf[ok_last_pos + i];
-        }
-        for (uint16_t i = 0; i < len2 && ok_len < sizeof(ok_buf) - 1; i++) {
-          ok_buf[ok_len++] = dma_rx_buf[i];
-        }
-      }
-      ok_last_pos = current_pos;
-
-      // 搜索 "OK"
-      for (uint16_t i = search_start_pos; i + 1 < ok_len; i++) {
-        if (ok_buf[i] == 'O' && ok_buf[i+1] == 'K') {
-          DEBUG_PRINT("[AT] OK received\r\n");
-          dma_rx_flush(); // 丢弃OK/回显，不让其进入 parse_buf
-          return true;
-        }
+#if USE_FREERTOS
+/* 追加一条AT命令：交给 config 任务发送，control 不等待串口。
+ * config 优先级低于 control，同一处理函数中连续入队的命令会在 config 运行前全部入队，构成一个序列 */
+static void at_enqueue(uint16_t timeout_ms, const char *fmt, ...)
+{
+  AtCmd c;
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(c.cmd, AT_CMD_LEN, fmt, ap);
+  va_end(ap);
+  c.timeout_ms = timeout_ms;
+
+  taskENTER_CRITICAL();
+  bool queued = (xQueueSend(at_cmd_queue, &c, 0) == pdPASS);
+  if (queued) {
+    at_pending++;
+    at_busy = true;
+  }
+  taskEXIT_CRITICAL();
+  if (!queued) DEBUG_PRINT("[AT] Queue full\r\n");
+}
+
+/* 丢弃未完成的序列（故障恢复用）：config 正在等待的命令完成后被忽略 */
+static void at_reset(void)
+{
+  taskENTER_CRITICAL();
+  xQueueReset(at_cmd_queue);
+  at_pending = 0;
+  at_busy = false;
+  at_gen++;
+  taskEXIT_CRITICAL();
+}
+#else
+/* 追加一条AT命令到序列；序列空闲时立即发送 */
+static void at_enqueue(uint16_t timeout_ms, const char *fmt, ...)
+{
+  if (at_q_len >= AT_QUEUE_MAX) {
+    DEBUG_PRINT("[AT] Queue full\r\n");
+    return;
+  }
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(at_queue[at_q_len].cmd, AT_CMD_LEN, fmt, ap);
+  va_end(ap);
+  at_queue[at_q_len].timeout_ms = timeout_ms;
+  at_q_len++;
+
+  if (!at_busy) {
+    at_busy = true;
+    at_q_idx = 0;
+    at_fail_count = 0;
+    at_ok_len = 0;
+    at_ok_pos = dma_get_pos();
+    at_cmd_start_ms = HAL_GetTick();
+    send_at("%s", at_queue[0].cmd);
+    sched_start(job_at, at_cmd_start_ms, AT_POLL_MS);
+  }
+}
+
+/* 丢弃未完成的序列（故障恢复用） */
+static void at_reset(void)
+{
+  sched_cancel(job_at);
+  at_busy = false;
+  at_q_len = 0;
+  at_q_idx = 0;
+}
+
+/* 轮询当前命令的OK（不污染全局 dma_last_pos，成功后统一 flush），完成后投递 EV_AT_DONE */
+static void at_poll(uint32_t now)
+{
+  if (!at_busy) return;
+
+  if (at_ok_scan()) {
+    DEBUG_PRINT("[AT] OK received\r\n");
+  } else if ((now - at_cmd_start_ms) >= at_queue[at_q_idx].timeout_ms) {
+    DEBUG_PRINT("[AT] OK timeout\r\n");
+    at_fail_count++;
+#if USE_BLACKBOX
+    bb_log(BB_EV_AT, 1, at_q_idx, at_fail_count, 0);
+#endif
+  } else {
+    return;
+  }
+  dma_rx_flush(); // 丢弃OK/回显，不让其进入 parse_buf
+
+  // 下一条
+  at_q_idx++;
+  if (at_q_idx < at_q_len) {
+    at_ok_len = 0;
+    at_ok_pos = dma_get_pos();
+    at_cmd_start_ms = now;
+    send_at("%s", at_queue[at_q_idx].cmd);
+    return;
+  }
+
+  // 序列完成：丢弃期间残留的半帧
+#if USE_BLACKBOX
+  bb_log(BB_EV_AT, 0, at_q_len, at_fail_count, 0);
+#endif
+  at_reset();
+  clear_parse_buffer();
+  ev_post(EV_AT_DONE);
+}
+#endif
+
+/* 开机初始化：停止、打开调试输出并重启，保留传感器自身的阈值 */
+static void at_queue_sensor_boot(void)
+{
+#if USE_WARM_BOOT
+  sensor_cfg_pending = true;   // 阈值保持传感器自身的，DETECT 可直接使用
+#endif
+  at_enqueue(100, "AT+STOP\r\n");
+  at_enqueue(200, "AT+DEBUG=1\r\n");
+  at_enqueue(500, "AT+REBOOT\r\n");
+}
+
+/* 进入 DETECT 的初始化：开机首次只做开机序列，之后（取杯/恢复）恢复默认阈值 */
+static void at_queue_sensor_init(void)
+{
+  if (at_boot_init_pending) {
+    at_boot_init_pending = false;
+    at_queue_sensor_boot();
+    return;
+  }
+  at_queue_sensor_defaults();
+}
+
+/* 传感器恢复默认阈值并重启 */
+static void at_queue_sensor_defaults(void)
+{
+#if USE_WARM_BOOT
+  sensor_cfg_pending = true;
+#endif
+  at_enqueue(100, "AT+STOP\r\n");
+  at_enqueue(200, "AT+DEBUG=1\r\n");
+  // 恢复默认阈值
+  at_enqueue(200, "AT+S3=60\r\n");
+  at_enqueue(200, "AT+T2=400\r\n");
+  at_enqueue(200, "AT+S4=152\r\n");
+  at_enqueue(200, "AT+T3=250\r\n");
+  at_enqueue(500, "AT+REBOOT\r\n");
+}
+
+/* 投递事件（主循环/任务上下文；中断中请用 isr_post） */
+static void ev_post(uint32_t ev)
+{
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  ev_pending |= ev;
+  __set_PRIMASK(primask);
+
+#if USE_FREERTOS
+  if (task_control_h != NULL) xTaskNotifyGive(task_control_h);
+#endif
+}
+
+/* 中断中投递带类型的事件（只能由 USART1 中断调用，保持单生产者） */
+static void isr_post(uint8_t type, uint32_t arg)
+{
+  SpscEvent_t e = { .type = type, .arg = arg };
+  spsc_push(&isr_queue, &e);
+
+#if USE_FREERTOS
+  if (task_control_h != NULL) {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(task_control_h, &woken);
+    portYIELD_FROM_ISR(woken);
+  }
+#endif
+}
+
+static bool events_pending(void)
+{
+  return ev_pending != 0 || !spsc_empty(&isr_queue);
+}
+
+/* 处理中断送来的事件 */
+static void drain_isr_events(uint32_t now)
+{
+  SpscEvent_t e;
+  while (spsc_pop(&isr_queue, &e)) {
+    switch (e.type) {
+#if USE_FREERTOS
+    // 解析与 OK 检测分别在 ingest/config 任务中进行：只唤醒对应任务
+    case SPSC_EV_FRAME_READY:
+      xTaskNotifyGive(task_ingest_h);
+      break;
+    case SPSC_EV_AT_RESPONSE:
+      xTaskNotifyGive(task_config_h);
+      break;
+#else
+    case SPSC_EV_FRAME_READY:
+      // 帧结束立即处理，不必等下一个50ms周期；周期任务顺延作为兜底
+      if (!at_busy) {
+        ingest_frames(now);
+        sched_start(job_ingest, now, INGEST_PERIOD_MS);
       }
-      search_start_pos = (ok_len > 1) ? (ok_len - 1) : 0;
+      break;
+    case SPSC_EV_AT_RESPONSE:
+      at_poll(now);
+      break;
+#endif
+    case SPSC_EV_CUTOFF:
+      ev_post(EV_FRAME); // 唤醒状态机完成停泵后的状态切换
+      break;
+    case SPSC_EV_UART_ERROR:
+      uart_err_count++;
+      DEBUG_PRINT("[UART] error 0x%lx (total %lu, isr_q overflow %lu)\r\n",
+                  (unsigned long)e.arg, (unsigned long)uart_err_count,
+                  (unsigned long)isr_queue.overflow);
+#if USE_FREERTOS
+      uart_restart_req = true; // DMA 读指针与解析缓冲归 ingest 任务
+      xTaskNotifyGive(task_ingest_h);
+#else
+      uart_rx_restart();
+#endif
+      break;
+    default:
+      break;
     }
-
-    HAL_Delay(1);
   }
-  DEBUG_PRINT("[AT] OK timeout\r\n");
-  return false;
 }
 
+/* 过载等错误会使 HAL 中止 DMA 接收：重新启动并从缓冲区起点读起 */
+static void uart_rx_restart(void)
+{
+  if (huart1.RxState != HAL_UART_STATE_READY) return; // 接收仍在进行（非阻塞错误）
+
+  __disable_irq();
+  uart_dma_start();
+  dma_last_pos = 0;
+  isr_scan_pos = 0;
+  __enable_irq();
+  clear_parse_buffer();
+}
+
+/* 取出并清除全部待处理事件 */
+static uint32_t ev_take(void)
+{
+  __disable_irq();
+  uint32_t ev = ev_pending;
+  ev_pending = 0;
+  __enable_irq();
+  return ev;
+}
+
+#if !USE_DEFERRED_LOG
 /* 调试输出 */
 static void debug_printf(const char *fmt, ...)
 {
 #if DEBUG_ENABLE
+#if USE_FREERTOS
+  char buf[LOG_LINE_LEN];    // 任务栈有限：过长的行截断而不是丢弃
+#else
   char buf[256];
+#endif
+  uint32_t t0 = dwt_cycles();
   va_list ap;
   va_start(ap, fmt);
   int n = vsnprintf(buf, sizeof(buf), fmt, ap);
   va_end(ap);
-  if (n > 0 && n < (int)sizeof(buf)) {
-    HAL_UART_Transmit(&huart2, (uint8_t*)buf, (uint16_t)n, 100);
+  if (n <= 0) return;
+#if USE_FREERTOS
+  if (n >= (int)sizeof(buf)) n = (int)sizeof(buf) - 1;
+#else
+  if (n >= (int)sizeof(buf)) return;
+#endif
+  txt_stats.fmt_cyc += dwt_cycles() - t0;
+  txt_stats.lines++;
+  txt_stats.bytes += (uint32_t)n;
+  log_write(buf, (uint16_t)n);
+#endif
+}
+#endif
+
+/* 文本输出：二进制遥测开启时装入 TLM_T_TEXT 帧，保持线上只有 COBS 帧 */
+static void log_write(const char *text, uint16_t len)
+{
+#if USE_BINARY_TELEMETRY
+  tlm_text(text, len);
+#else
+  uart2_write((const uint8_t *)text, len);
+#endif
+}
+
+/* USART2 发送：RTOS 调度器运行后入队由遥测任务发送，否则阻塞发送 */
+static void uart2_write(const uint8_t *data, uint16_t len)
+{
+#if USE_FREERTOS
+  if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) {
+    while (len > 0) {
+      LogLine line;
+      line.len = (uint8_t)((len < LOG_LINE_LEN) ? len : LOG_LINE_LEN);
+      memcpy(line.text, data, line.len);
+      if (xQueueSend(log_queue, &line, 0) != pdPASS) {
+        log_drop_count++;
+        return;
+      }
+      data += line.len;
+      len = (uint16_t)(len - line.len);
+    }
+    return;
   }
 #endif
+  HAL_UART_Transmit(&huart2, (uint8_t *)data, len, 100);
+}
+
+#if USE_BINARY_TELEMETRY
+static int16_t tlm_sat16(int32_t v)
+{
+  return (int16_t)((v > 32767) ? 32767 : (v < -32768) ? -32768 : v);
+}
+
+/* 每帧一条记录（替代逐帧文本打印） */
+static void tlm_frame(int b)
+{
+  TlmFrame_t f;
+  f.a = tlm_sat16(current_frame.a);
+  f.b = tlm_sat16(b);
+  f.a_filtered = tlm_sat16(a_filtered);
+#if USE_KALMAN_DISTANCE
+  f.rate = tlm_sat16(kalman_dist_rate(&a_kf));
+  f.innov = tlm_sat16(kalman_dist_innovation(&a_kf));
+#else
+  f.rate = 0;
+  f.innov = 0;
+#endif
+  f.state = (uint8_t)app_state;
+  tlm_send(TLM_T_FRAME, &f, sizeof(f));
+}
+
+/* CONFIGURE 结果与由其导出的 VERIFY/MEASURE 参数 */
+static void tlm_thresh(const ThresholdResult_t *r, uint8_t cache_hit)
+{
+  TlmThresh_t t;
+  t.edge_idx = r->edge_idx;
+  t.liquid_idx = r->liquid_idx;
+  t.x = r->x;
+  t.t1 = r->t1;
+  t.y = r->y;
+  t.t2 = r->t2;
+  t.sep = r->sep;
+  t.t1_headroom = r->t1_headroom;
+  t.edge_distance = tlm_sat16(edge_distance);
+  t.cup_depth = tlm_sat16(cup_depth);
+  t.alarm_distance = tlm_sat16(alarm_distance_check);
+  t.stop_distance = tlm_sat16(stop_distance);
+  t.peak_count = r->peak_count;
+  t.edge_extension = r->edge_extension;
+  t.edge_prom_pct = (uint8_t)r->edge_prom_pct;
+  t.liquid_prom_pct = (uint8_t)r->liquid_prom_pct;
+  t.confidence = r->confidence;
+  t.strong_echo = require_strong_echo;
+  t.cache_hit = cache_hit;
+  tlm_send(TLM_T_THRESH, &t, sizeof(t));
+}
+
+static void tlm_metric(uint8_t id, int32_t value, int32_t aux)
+{
+  TlmMetric_t m = { id, value, aux };
+  tlm_send(TLM_T_METRIC, &m, sizeof(m));
+}
+
+/* 启动时对比一帧数据的两种输出：文本格式化 vs 结构体编码（DWT 周期 + 线上字节） */
+static void tlm_benchmark(void)
+{
+  char line[LOG_LINE_LEN];
+  uint8_t frame[TLM_MAX_FRAME];
+  TlmFrame_t f = { 1234, 567, 1230, -85, 12, STATE_MEASURE };
+
+  uint32_t t0 = dwt_cycles();
+  int n_txt = snprintf(line, sizeof(line), "a=%d, a_filtered=%d, rate=%ld, innov=%d, [PARSE] SUCCESS\r\n",
+                       f.a, f.a_filtered, (long)f.rate, f.innov);
+  uint32_t c_txt = dwt_cycles() - t0;
+  t0 = dwt_cycles();
+  uint16_t n_bin = tlm_encode(TLM_T_FRAME, 0, HAL_GetTick(), &f, sizeof(f), frame);
+  uint32_t c_bin = dwt_cycles() - t0;
+#if USE_DEFERRED_LOG
+  // 同一行文本走延迟格式化：编号 + 4 个参数字（只取格式串地址，编号不必有效）
+  uint8_t payload[TLM_MAX_PAYLOAD];
+  const uintptr_t args[] = { (uintptr_t)f.a, (uintptr_t)f.a_filtered, (uintptr_t)f.rate, (uintptr_t)f.innov };
+  t0 = dwt_cycles();
+  uint16_t n_log = dlog_encode("", 0, 4, args, payload);
+  n_log = tlm_encode(TLM_T_LOG, 0, HAL_GetTick(), payload, n_log, frame);
+  uint32_t c_log = dwt_cycles() - t0;
+  DEBUG_PRINT("[TLM] same line as deferred log: %u B / %lu us enc / %lu us tx\r\n",
+              n_log, (unsigned long)dwt_cycles_to_us(c_log), (unsigned long)(n_log * UART2_US_PER_BYTE));
+#endif
+
+  DEBUG_PRINT("[TLM] frame record: text %d B / %lu us fmt / %lu us tx, binary %u B / %lu us enc / %lu us tx\r\n",
+              n_txt, (unsigned long)dwt_cycles_to_us(c_txt), (unsigned long)(n_txt * UART2_US_PER_BYTE),
+              n_bin, (unsigned long)dwt_cycles_to_us(c_bin), (unsigned long)(n_bin * UART2_US_PER_BYTE));
 }
+#endif
 
 /* USER CODE END 0 */
 
@@ -497,469 +1263,78 @@ int main(void)
   HAL_GPIO_WritePin(GPIOB, GPIO_PIN_0, GPIO_PIN_RESET); // 默认停止(低电平)
 #endif
 
+  spsc_init(&isr_queue);
+#if USE_BINARY_TELEMETRY
+  dwt_init();              // 文本/编码耗时统计
+  tlm_init(uart2_write);   // 之后的 DEBUG_PRINT 都以 COBS 帧输出
+#endif
+#if USE_WARM_BOOT
+  warm_restore();
+#endif
+#if USE_CUP_CACHE
+  cup_cache_init(&cup_cache);
+#endif
+#if USE_FLASH_KV
+  kv_restore();
+#endif
+#if USE_BLACKBOX
+  const BbHeader_t *bb = bb_saved();
+  if (bb) {
+    DEBUG_PRINT("[BB] Saved log #%lu: reason=%d, %d records, flushed at %lu ms, %s (send 'B' on USART2 to dump)\r\n",
+                (unsigned long)bb->seq, bb->reason, bb->count, (unsigned long)bb->t_ms,
+                (bb->exported == BB_NOT_EXPORTED) ? "not exported" : "exported");
+  }
+#endif
   uart_dma_start();
-
-#if !TEST_MODE_ENABLE
-  HAL_Delay(100);
-//  send_at("AT+RESET\r\n");
-//  wait_for_ok(1000);
-  send_at("AT+STOP\r\n");
-  wait_for_ok(200);
-  dma_rx_flush();
-
-  send_at("AT+DEBUG=1\r\n");
-  wait_for_ok(500);
-
-//  send_at("AT+S3=60\r\n");
-//  wait_for_ok(500);
-//
-//  send_at("AT+T2=400\r\n");
-//  wait_for_ok(500);
-//
-//  send_at("AT+S4=152\r\n");
-//  wait_for_ok(500);
-//
-//  send_at("AT+T3=250\r\n");
-//  wait_for_ok(500);
-
-  send_at("AT+REBOOT\r\n");
-  wait_for_ok(500);
-  dma_rx_flush(); // 丢弃启动回显/提示
+#if USE_FAST_CUTOFF
+  fast_cutoff_init(pump_off_isr);
 #endif
+#if USE_BINARY_TELEMETRY
+  tlm_benchmark();
+#endif
+  __HAL_UART_ENABLE_IT(&huart1, UART_IT_IDLE); // 帧结束后的空闲中断
+
   HAL_GPIO_WritePin(GPIOB, GPIO_PIN_1, GPIO_PIN_RESET);
   HAL_GPIO_WritePin(GPIOA, GPIO_PIN_6, GPIO_PIN_RESET);
   HAL_GPIO_WritePin(GPIOA, GPIO_PIN_7, GPIO_PIN_RESET);
 
-  app_state = STATE_DETECT;
   current_frame.valid = false;
 
   // [新增] 初始化“最后一次成功解析时间”为当前时间，避免上电即触发
   last_parse_ok_ms = HAL_GetTick();
 
+  // 注册周期任务；状态机在 BOOT_DELAY_MS 后由单次任务启动
+  sched_setup(last_parse_ok_ms);
+
   DEBUG_PRINT("\r\n=== System Init OK ===\r\n");
 
-  uint32_t last_process = HAL_GetTick();
-  uint32_t frame_timeout = HAL_GetTick();
+#if USE_FREERTOS
+  app_rtos_start(); // 不返回
+#endif
   /* USER CODE END 2 */
 
   /* Infinite loop */
   /* USER CODE BEGIN WHILE */
   while (1)
   {
-	    uint32_t now = HAL_GetTick();
-
-	    // 定期处理DMA数据
-	    if (now - last_process >= 50) {
-	      last_process = now;
-	      process_dma_data();
-
-	      // 解析尝试
-	      if (parse_len > 50) {
-	        // 如果解析成功
-	        if (parse_sensor_frame(parse_buf, parse_len, &current_frame)) {
-	          #if TEST_MODE_ENABLE
-	          test_frame_count++;
-	          #endif
-
-	          update_a_moving_average(current_frame.a, a_ma_window);
-	          last_a = current_frame.a;
-	          last_b = current_frame.b;           // 新增：记录最近的 b
-	          a_changed = true;
-
-	          // [新增] 记录成功解析时间
-	          last_parse_ok_ms = now;
-
-	          // 解析成功：从缓冲区中移除“最后一个 a:”之前的数据
-	          int cut = find_last_frame_start(parse_buf, parse_len);
-	          if (cut > 0) {
-	            uint16_t remain = parse_len - (uint16_t)cut;
-	            memmove(parse_buf, parse_buf + cut, remain);
-	            parse_len = remain;
-	          } else {
-	            // 仅有当前这帧的 a:，清空缓冲
-	            clear_parse_buffer();
-	          }
-
-	          frame_timeout = now;
-	          DEBUG_PRINT("a=%d, a_filtered=%d, [PARSE] SUCCESS\r\n", current_frame.a, a_filtered);
-
-	        } else {
-	          #if TEST_MODE_ENABLE
-	          test_parse_fail++;
-	          #endif
-
-              if (current_frame.a != last_a){
-	        	update_a_moving_average(current_frame.a, a_ma_window);
-	        	last_a = current_frame.a;
-                a_changed = true;
-                DEBUG_PRINT("a=%d, a_filtered=%d\r\n", current_frame.a, a_filtered);
-	            }
-
-	          // 解析失败：尝试剪到最后一个 a:
-	          int cut = find_last_frame_start(parse_buf, parse_len);
-	          if (cut > 0) {
-	            uint16_t remain = parse_len - (uint16_t)cut;
-	            memmove(parse_buf, parse_buf + cut, remain);
-	            parse_len = remain;
-	          }
-
-	          // 超时或过满则清空
-	          if (now - frame_timeout > 2000) {
-	            clear_parse_buffer();
-	            frame_timeout = now;
-	          } else if (parse_len > 1500) {
-	            clear_parse_buffer();
-	            frame_timeout = now;
-	          }
-	        }
-
-	      }
-
-	      // 测试统计
-	      #if TEST_MODE_ENABLE
-	      if (now - test_last_report > 5000) {
-	        test_last_report = now;
-	        DEBUG_PRINT("\r\n--- Test Report ---\r\n");
-	        DEBUG_PRINT("Frames OK: %lu\r\n", test_frame_count);
-	        DEBUG_PRINT("Parse fail: %lu\r\n", test_parse_fail);
-	        DEBUG_PRINT("a_filtered: %d\r\n", a_filtered);
-	        DEBUG_PRINT("State: %d\r\n\r\n", app_state);
-	      }
-	      #endif
-	    }
-
-        // [新增] 无新数据解析看门狗：10秒无成功解析则恢复
-        if ((HAL_GetTick() - last_parse_ok_ms) > NO_PARSE_RESET_MS) {
-          DEBUG_PRINT("[WATCHDOG] No parsed frame for %lu ms, perform %s reset\r\n",
-                      (unsigned long)(HAL_GetTick() - last_parse_ok_ms),
-                      (USE_HARD_RESET_ON_NO_PARSE ? "MCU" : "sensor"));
-          if (USE_HARD_RESET_ON_NO_PARSE) {
-            system_hard_reset(); // 不会返回
-          } else {
-            sensor_soft_recover(); // 仅复位传感器，继续运行
-            last_parse_ok_ms = HAL_GetTick(); // 避免立刻再次触发
-          }
-        }
-
-	  // 状态机
-  #if !TEST_MODE_ENABLE  // 正常模式才运行状态机
-	  switch (app_state) {
-		case STATE_DETECT:
-		{
-		  a_ma_window = 16;
-
-		  if (current_frame.valid) {
-			if (a_filtered < THRESH_DETECT_STOP) {
-			  state_confirm_count++;
-
-			  if (state_confirm_count >= DETECT_CONFIRM_COUNT_MAX) {
-				DEBUG_PRINT("[DETECT->CONFIGURE] Confirmed!\r\n");
-
-				send_at("AT+STOP\r\n");
-				wait_for_ok(200);
-				dma_rx_flush();
-
-				app_state = STATE_CONFIGURE;
-
-				state_confirm_count = 0;
-			  }
-			} else {
-			  state_confirm_count = 0;
-			}
-
-			current_frame.valid = false;
-		  }
-		  break;
-		}
-
-		case STATE_CONFIGURE:
-		{
-		  // 调用超声波阈值算法
-		  ThresholdResult_t thresh_result;
-		  int16_t s_array[S_COUNT];
-		  for (int i = 0; i < S_COUNT; i++) {
-		    s_array[i] = (int16_t)current_frame.s[i];
-		  }
-
-		  compute_thresholds(s_array, S_COUNT, &thresh_result);
-
-		  DEBUG_PRINT("\r\n=== CONFIGURE RESULT ===\r\n");
-		  DEBUG_PRINT("edge_idx: %d\r\n", thresh_result.edge_idx);
-		  DEBUG_PRINT("liquid_idx: %d\r\n", thresh_result.liquid_idx);
-		  DEBUG_PRINT("x: %d\r\n", thresh_result.x);
-		  DEBUG_PRINT("t1: %d\r\n", thresh_result.t1);
-		  DEBUG_PRINT("y: %d\r\n", thresh_result.y);
-		  DEBUG_PRINT("t2: %d\r\n", thresh_result.t2);
-		  DEBUG_PRINT("peak_count: %d\r\n", thresh_result.peak_count);
-		  DEBUG_PRINT("edge_extension: %d\r\n", thresh_result.edge_extension); // <-- 新增打印
-
-		  // 检查是否检测到容器
-		  if (thresh_result.edge_idx < 0 || thresh_result.liquid_idx < 0) {
-		    DEBUG_PRINT("[CONFIGURE] No container detected, skip to WAIT\r\n");
-		    DEBUG_PRINT("========================\r\n\r\n");
-
-            HAL_GPIO_WritePin(GPIOA, GPIO_PIN_6, GPIO_PIN_SET);
-
-		    send_at("AT+REBOOT\r\n");
-		    wait_for_ok(500);
-            dma_rx_flush(); // 丢弃启动回显/提示
-
-		    reset_moving_average();
-		    a_ma_window = 16;
-		    state_confirm_count = 0;
-		    current_frame.valid = false;
-            stop_distance = 0; // <-- 无容器时重置，避免旧值残留
-
-		    app_state = STATE_WAIT;
-		    break;
-		  }
-
-		  // 计算参数
-		  x_param = thresh_result.x;
-		  t1_param = thresh_result.t1;
-		  y_param = thresh_result.y;
-		  t2_param = thresh_result.t2;
-		  edge_distance = (int)((thresh_result.edge_idx * 430) / 225);
-		  // [新逻辑] 计算VERIFY阶段要使用的距离阈值 (来自 x_param)
-		  alarm_distance_check = (int)((x_param * 430) / 225);
-
-          DEBUG_PRINT("Calculated edge_distance: %d\r\n", edge_distance);
-          // [新逻辑] 打印VERIFY的阈值
-          DEBUG_PRINT("Calculated alarm_distance_check: %d\r\n", alarm_distance_check);
-
-          // [新逻辑] 计算 stop_distance
-          if (thresh_result.edge_extension == 0) {
-            stop_distance = (int)(((x_param + 1) * 430) / 225);
-          } else {
-            stop_distance = edge_distance + 20;
-          }
-          // 新增：在 edge_extension==0 时启用强回波校验
-          require_strong_echo = (thresh_result.edge_extension == 0);
-          DEBUG_PRINT("Calculated stop_distance: %d, strong_echo_check=%d\r\n", stop_distance, require_strong_echo);
-          DEBUG_PRINT("========================\r\n\r\n");
-
-		  send_at("AT+S3=%d\r\n", x_param);
-		  wait_for_ok(500);
-
-		  send_at("AT+S4=%d\r\n", y_param);
-		  wait_for_ok(500);
-
-		  send_at("AT+T2=%d\r\n", t1_param);
-		  wait_for_ok(500);
-
-		  send_at("AT+T3=%d\r\n", t2_param);
-		  wait_for_ok(500);
-
-		  send_at("AT+REBOOT\r\n");
-		  wait_for_ok(500);
-		  dma_rx_flush();
-
-		  reset_moving_average();
-		  a_ma_window = 3; // 验证和测量阶段使用快速均值
-		  state_confirm_count = 0;
-		  verify_confirm_count = 0; // [新逻辑] 重置验证计数器
-		  current_frame.valid = false;
-
-          HAL_GPIO_WritePin(GPIOA, GPIO_PIN_7, GPIO_PIN_SET);
-
-		  app_state = STATE_VERIFY; // [修改] 下一状态改为VERIFY
-		  DEBUG_PRINT("[CONFIGURE->VERIFY]\r\n");
-		  break;
-		}
-
-        /* --- [新状态] --- */
-		case STATE_VERIFY:
-		{
-		  // 保持在3点均值，快速响应
-		  a_ma_window = 3;
-
-		  if (current_frame.valid) {
-			int raw_a = current_frame.a;
-			int raw_b = current_frame.b;
-			current_frame.valid = false;
-
-			// 检查：原始a值是否 < 我们根据x设置的距离阈值
-			// 如果是，说明t1阈值被边沿噪声突破了
-			if (raw_a <= alarm_distance_check) {
-			  // 失败：检测到回波 < 设定值
-			  DEBUG_PRINT("[VERIFY] Failed! a=%d < %d. Adjusting T1.\r\n", raw_a, alarm_distance_check);
-
-			  // 按要求增加阈值 = b + 50
-              if (raw_b > t1_param){
-                t1_param = raw_b + 50;
-              }
-              else {
-                t1_param += 20; // 保底增加20
-              }
-
-			  DEBUG_PRINT("[VERIFY] New t1_param = %d\r\n", t1_param);
-
-			  // 停止
-			  send_at("AT+STOP\r\n");
-			  wait_for_ok(200);
-			  dma_rx_flush();
-
-			  // 重新配置T1 (对应AT+T2)
-			  send_at("AT+T2=%d\r\n", t1_param);
-			  wait_for_ok(500);
-			  dma_rx_flush();
-
-			  // 重启
-			  send_at("AT+REBOOT\r\n");
-			  wait_for_ok(150);
-			  dma_rx_flush();
-
-			  // 重置计数和均值
-			  verify_confirm_count = 0;
-			  reset_moving_average();
-
-			} else {
-			  // 成功：未检测到突破
-			  verify_confirm_count++;
-			  DEBUG_PRINT("[VERIFY] OK (%d/%d). a=%d\r\n", verify_confirm_count, VERIFY_COUNT_MAX, raw_a);
-
-			  if (verify_confirm_count >= VERIFY_COUNT_MAX) {
-				// 连续8次成功，进入测量
-				DEBUG_PRINT("[VERIFY->MEASURE] Verification complete!\r\n");
-
-				app_state = STATE_MEASURE;
-
-				verify_confirm_count = 0; // 重置验证计数
-				state_confirm_count = 0;  // 重置状态计数
-				reset_moving_average();   // 测量阶段重新开始计算均值
-				a_ma_window = 3;          // 确保测量阶段是3点均值
-        measure_enter_ms = now; // 记录进入时间，刚开始降敏
-				pump_start();
-			  }
-			}
-		  }
-		  break;
-		}
-        /* --- [新状态结束] --- */
-
-		case STATE_MEASURE:
-		{
-          if (a_hist_count >= a_ma_window) { // a_ma_window 此时为 3
-            // 新增：组合触发条件
-            int b_threshold = t1_param / 3;
-            bool stop_cond = (a_filtered < stop_distance);
-            if (require_strong_echo) {
-              stop_cond = stop_cond && (last_b > b_threshold);
-            }
-
-            bool measure_armed = (measure_enter_ms != 0) && ((now - measure_enter_ms) >= MEASURE_GRACE_MS);
-
-            if (measure_armed && stop_cond) {
-              if (a_changed){
-                state_confirm_count++;
-                a_changed = false;
-
-                if (state_confirm_count >= MEASURE_CONFIRM_COUNT_MAX ) {
-                  DEBUG_PRINT("[MEASURE->WAIT] ALERT ON! a_f=%d < %d, b=%d > %d, strong=%d\r\n",
-                              a_filtered, stop_distance, last_b, b_threshold, require_strong_echo);
-                  pump_stop();
-                  HAL_GPIO_WritePin(GPIOA, GPIO_PIN_7, GPIO_PIN_RESET);
-                  HAL_GPIO_WritePin(GPIOA, GPIO_PIN_6, GPIO_PIN_SET);
-
-                  send_at("AT+STOP\r\n");
-                  wait_for_ok(100);
-                  dma_rx_flush();
-
-//                  send_at("AT+DEBUG=1\r\n");
-//                  wait_for_ok(200);
-//                  // 恢复默认阈值
-//                  send_at("AT+S3=60\r\n");
-//                  wait_for_ok(200);
-//
-//                  send_at("AT+T2=400\r\n");
-//                  wait_for_ok(200);
-//
-//                  send_at("AT+S4=152\r\n");
-//                  wait_for_ok(200);
-
-                  send_at("AT+T3=250\r\n");
-                  wait_for_ok(200);
-
-                  send_at("AT+REBOOT\r\n");
-                  wait_for_ok(500);
-                  dma_rx_flush();
-
-                  reset_moving_average();
-                  a_ma_window = 16;
-                  current_frame.valid = false;
-
-                  app_state = STATE_WAIT;
-                  state_confirm_count = 0;
-                }
-              }
-            } else {
-              state_confirm_count = 0;
-            }
-          }
-
-		  break;
-		}
-
-		case STATE_WAIT:
-		{
-		  if (current_frame.valid) {
-			if (a_filtered > THRESH_MEASURE_HIGH) {
-			  state_confirm_count++;
-
-			  if (state_confirm_count >= WAIT_CONFIRM_COUNT_MAX) {
-				DEBUG_PRINT("[WAIT->DETECT] Reset!\r\n");
-
-				send_at("AT+STOP\r\n");
-				wait_for_ok(100);
-				dma_rx_flush();
-
-				send_at("AT+DEBUG=1\r\n");
-				wait_for_ok(200);
-				// 恢复默认阈值
-				send_at("AT+S3=60\r\n");
-				wait_for_ok(200);
-
-				send_at("AT+T2=400\r\n");
-				wait_for_ok(200);
-
-				send_at("AT+S4=152\r\n");
-				wait_for_ok(200);
-
-				send_at("AT+T3=250\r\n");
-				wait_for_ok(200);
-
-				HAL_GPIO_WritePin(GPIOA, GPIO_PIN_6, GPIO_PIN_RESET);
-				HAL_GPIO_WritePin(GPIOA, GPIO_PIN_7, GPIO_PIN_RESET); // [修正] 退出WAIT时应熄灭两个灯
-
-				send_at("AT+REBOOT\r\n");
-				wait_for_ok(500);
-				dma_rx_flush();
-
-				reset_moving_average();
-				a_ma_window = 16;
-				state_confirm_count = 0;
-				current_frame.valid = false;
-                stop_distance = 0; // <-- 复位路径重置
-                require_strong_echo = false; // 新增：复位强回波校验
-
-                app_state = STATE_DETECT;
-              }
-			} else {
-			  state_confirm_count = 0;
-			}
-
-			current_frame.valid = false;
-		  }
-		  break;
-		}
-
-		default:
-		  app_state = STATE_DETECT;
-		  break;
-	  }
-  #endif
+    uint32_t now = HAL_GetTick();
+
+    // 中断事件（帧就绪、AT应答、快速停泵、串口错误）
+    drain_isr_events(now);
+
+    // 执行所有到期任务（帧处理、AT轮询、超时、状态定时器）
+    sched_run(now);
+
+    // 仅在有事件时运行状态机
+    if (ev_pending) {
+      fsm_dispatch(now);
+      continue; // 状态处理可能启动了新任务，重新计算下一个到期时间
+    }
 
-	  HAL_Delay(5);
+    // 空闲：休眠到下一个到期时间或有中断投递事件（SysTick/DMA/UART均可唤醒）
+    while (!events_pending() && sched_next_in(HAL_GetTick()) > 0) {
+      cpu_idle();
+    }
     /* USER CODE END WHILE */
 
     /* USER CODE BEGIN 3 */
@@ -1021,11 +1396,56 @@ void pump_start(void)
 #endif
 }
 
+/**
+  * @brief 中断中关断水泵：直接写寄存器，固定时间完成（HAL 状态由主循环的 pump_stop() 补齐）
+  */
+static void pump_off_isr(void)
+{
+  pump_hw_off();
+  isr_post(SPSC_EV_CUTOFF, 0); // 唤醒状态机完成后续处理
+}
+
+/**
+  * @brief USART1 空闲中断回调（stm32f1xx_it.c 调用）：把新到的字节交给快速停泵扫描器，并通知主循环
+  */
+void app_uart1_idle_isr(void)
+{
+  uint16_t pos = dma_get_pos();
+#if USE_FAST_CUTOFF
+  fast_cutoff_feed(dma_rx_buf, DMA_RX_BUF_SIZE, isr_scan_pos, pos);
+#endif
+  isr_scan_pos = pos;
+  isr_post(at_busy ? SPSC_EV_AT_RESPONSE : SPSC_EV_FRAME_READY, pos);
+}
+
+/**
+  * @brief USART1 错误（过载/帧错误/噪声）：交给主循环统计并在需要时重启DMA接收
+  */
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+  if (huart->Instance == USART1) {
+    isr_post(SPSC_EV_UART_ERROR, huart->ErrorCode);
+  }
+}
+
+/**
+  * @brief 设置水泵 PWM 占空（CCR3，0~Period），GPIO 模式下无效
+  */
+void pump_set_duty(uint16_t ccr)
+{
+#if (USE_PWM_MODE == 1)
+  __HAL_TIM_SET_COMPARE(&htim3, TIM_CHANNEL_3, ccr);
+#else
+  (void)ccr;
+#endif
+}
+
 /**
   * @brief 停止水泵（根据宏定义执行 PWM Stop 或 GPIO Low）
   */
 void pump_stop(void)
 {
+  pump_hw_off(); // 先直接关断：HardFault/复位路径中调用时不等 HAL
 #if (USE_PWM_MODE == 1)
   // PWM 模式：停止 TIM3 的通道3
   HAL_TIM_PWM_Stop(&htim3, TIM_CHANNEL_3);
@@ -1035,55 +1455,1547 @@ void pump_stop(void)
 #endif
 }
 
-// [新增] 整机软件复位：等效于按下硬复位（由 NVIC 触发）
-static void system_hard_reset(void)
-{
-  DEBUG_PRINT("[WATCHDOG] NVIC_SystemReset()\r\n");
-  HAL_Delay(5); // 尽量把日志发出去
-  NVIC_SystemReset();
-}
+/* ======================= 帧接收 ======================= */
 
-// [新增] 仅复位传感器与控制状态，逻辑同 WAIT->DETECT 分支
-static void sensor_soft_recover(void)
+/* 处理DMA数据并尝试解析；得到新的 a 时投递 EV_FRAME */
+/* DMA 数据 -> 解析缓冲 -> 帧：只读写解析缓冲与 frame（RTOS 构建中由 ingest 任务独占） */
+static uint8_t ingest_parse(SensorFrame *frame)
 {
-  DEBUG_PRINT("[WATCHDOG] Soft sensor recovery\r\n");
+  process_dma_data();
+  if (parse_len <= 50) return INGEST_NONE;
+
+  // 如果解析成功
+  if (parse_sensor_frame(parse_buf, parse_len, frame)) {
+    #if TEST_MODE_ENABLE
+    test_frame_count++;
+    #endif
+    ingest_last_a = frame->a;
+
+    // 解析成功：从缓冲区中移除“最后一个 a:”之前的数据
+    int cut = find_last_frame_start(parse_buf, parse_len);
+    if (cut > 0) {
+      uint16_t remain = parse_len - (uint16_t)cut;
+      memmove(parse_buf, parse_buf + cut, remain);
+      parse_len = remain;
+    } else {
+      // 仅有当前这帧的 a:，清空缓冲
+      clear_parse_buffer();
+    }
+    return INGEST_FULL;
+  }
 
-  send_at("AT+STOP\r\n");
-  wait_for_ok(100);
-  dma_rx_flush();
+  #if TEST_MODE_ENABLE
+  test_parse_fail++;
+  #endif
+  uint8_t r = INGEST_NONE;
+  if (frame->a != ingest_last_a) {
+    ingest_last_a = frame->a;
+    r = INGEST_A_ONLY;
+  }
 
-  send_at("AT+DEBUG=1\r\n");
-  wait_for_ok(200);
+  // 解析失败：尝试剪到最后一个 a:
+  int cut = find_last_frame_start(parse_buf, parse_len);
+  if (cut > 0) {
+    uint16_t remain = parse_len - (uint16_t)cut;
+    memmove(parse_buf, parse_buf + cut, remain);
+    parse_len = remain;
+  }
 
-  // 恢复默认阈值
-  send_at("AT+S3=60\r\n");
-  wait_for_ok(200);
+  // 过满则清空（超时清空由 job_parse_stale / ingest 任务负责）
+  if (parse_len > 1500) {
+    clear_parse_buffer();
+    r |= INGEST_OVERFLOW;
+  }
+  return r;
+}
 
-  send_at("AT+T2=400\r\n");
-  wait_for_ok(200);
+/* 新帧（current_frame 已更新）交给滤波、看门狗与状态机；RTOS 构建中在控制任务中运行 */
+static void frame_apply(uint8_t r, uint32_t now)
+{
+  if (r & INGEST_FULL) {
+#if USE_WARM_BOOT
+    if (boot_first_frame_ms == 0) {
+      // SysTick 从 HAL_Init 起计时：即复位到首个解析帧的时间
+      boot_first_frame_ms = now ? now : 1;
+#if USE_BINARY_TELEMETRY
+      tlm_metric(TLM_M_BOOT_FIRST_FRAME, (int32_t)now, boot_code);
+#else
+      DEBUG_PRINT("[METRIC] boot_to_first_frame=%lu ms (%s)\r\n", (unsigned long)now, boot_kind);
+#endif
+    }
+#endif
+    update_a_filter(current_frame.a, current_frame.b, now);
+    last_a = current_frame.a;
+    last_b = current_frame.b;           // 新增：记录最近的 b
+    frame_seq++;
+    frame_ts_ms = now;
+
+    // 实测帧间隔（用于延迟预算）与注水速率样本
+    if (last_frame_ms != 0 && now - last_frame_ms < 1000) {
+      frame_interval_ms = (frame_interval_ms * 7 + (now - last_frame_ms)) / 8;
+    }
+    last_frame_ms = now;
+    if (app_state == STATE_MEASURE) fill_rate_push(&fill_rate, current_frame.a, now);
+
+    // [新增] 记录成功解析时间，推迟看门狗与陈旧超时
+    last_parse_ok_ms = now;
+    sched_start(job_watchdog, now, NO_PARSE_RESET_MS);
+#if !USE_FREERTOS
+    sched_start(job_parse_stale, now, PARSE_STALE_MS);
+#endif
 
-  send_at("AT+S4=152\r\n");
-  wait_for_ok(200);
+#if USE_BINARY_TELEMETRY
+    tlm_frame(current_frame.b);
+#elif USE_KALMAN_DISTANCE
+    DEBUG_PRINT("a=%d, a_filtered=%d, rate=%ld, innov=%d, [PARSE] SUCCESS\r\n", current_frame.a, a_filtered,
+                (long)kalman_dist_rate(&a_kf), kalman_dist_innovation(&a_kf));
+#else
+    DEBUG_PRINT("a=%d, a_filtered=%d, [PARSE] SUCCESS\r\n", current_frame.a, a_filtered);
+#endif
 
-  send_at("AT+T3=250\r\n");
-  wait_for_ok(200);
+#if USE_LIQUID_TRACKER
+    // 液位峰跟踪：只在已完成配置后运行，每帧只搜索上次位置附近的小窗口
+    if (liquid_trk.locked && (app_state == STATE_VERIFY || app_state == STATE_MEASURE)) {
+      if (liquid_tracker_update(&liquid_trk, current_frame.s, S_COUNT, now)) {
+        DEBUG_PRINT("[TRACK] d=%d, level=%d%%, rate=%ld\r\n",
+                    liquid_tracker_distance(&liquid_trk), liquid_trk.level_pct,
+                    (long)(liquid_trk.rate_q / TRACK_Q));
+      } else if (!liquid_trk.locked) {
+        DEBUG_PRINT("[TRACK] Lost\r\n");
+      }
+    }
+#endif
+    ev_post(EV_FRAME);
+  } else if (r & INGEST_A_ONLY) {
+    update_a_filter(current_frame.a, -1, now);
+    last_a = current_frame.a;
+    frame_seq++;
+    frame_ts_ms = now;
+    if (app_state == STATE_MEASURE) fill_rate_push(&fill_rate, current_frame.a, now);
+#if USE_BINARY_TELEMETRY
+    tlm_frame(-1);
+#else
+    DEBUG_PRINT("a=%d, a_filtered=%d\r\n", current_frame.a, a_filtered);
+#endif
+    ev_post(EV_FRAME);
+  }
+#if !USE_FREERTOS
+  if (r & INGEST_OVERFLOW) sched_start(job_parse_stale, now, PARSE_STALE_MS);
+#endif
+}
 
-  HAL_GPIO_WritePin(GPIOA, GPIO_PIN_6, GPIO_PIN_RESET);
-  HAL_GPIO_WritePin(GPIOA, GPIO_PIN_7, GPIO_PIN_RESET);
+#if !USE_FREERTOS
+static void ingest_frames(uint32_t now)
+{
+  frame_apply(ingest_parse(&current_frame), now);
+}
+#endif
 
-  send_at("AT+REBOOT\r\n");
-  wait_for_ok(500);
-  dma_rx_flush();
+/* ======================= 调度任务 ======================= */
 
-  reset_moving_average();
-  a_ma_window = 16;
-  state_confirm_count = 0;
-  current_frame.valid = false;
+#if !USE_FREERTOS  // RTOS 构建中由 ingest/config 任务完成
+static void job_ingest_fn(uint32_t now)
+{
+  // AT 序列进行中只等待OK，不解析帧
+  if (!at_busy) ingest_frames(now);
+}
+
+static void job_at_fn(uint32_t now)
+{
+  at_poll(now);
+}
+
+// 长时间没有成功解析：丢弃缓冲区中的残帧（周期任务，成功解析时被推迟）
+static void job_parse_stale_fn(uint32_t now)
+{
+  (void)now;
+  if (parse_len > 0) clear_parse_buffer();
+}
+#endif
+
+static void job_watchdog_fn(uint32_t now)
+{
+  (void)now;
+  ev_post(EV_FAULT);
+}
+
+static void job_state_timer_fn(uint32_t now)
+{
+  (void)now;
+  ev_post(EV_TIMER);
+}
+
+static void job_boot_fn(uint32_t now)
+{
+#if !TEST_MODE_ENABLE
+  // 进入DETECT：其进入动作下发 STOP/DEBUG/默认阈值/REBOOT
+  fsm_start(now);
+#else
+  (void)now;
+#endif
+}
+
+#if USE_WARM_BOOT
+// 开机：区分冷/热启动；复位前已在 DETECT 且传感器为默认配置时，跳过上电延时与 AT 初始化
+static void warm_restore(void)
+{
+  uint8_t warm = warm_boot_init();
+  WarmSnapshot_t snap;
+
+  if (!warm_boot_take(&snap)) {
+    boot_kind = warm ? "warm" : "cold";
+    boot_code = warm ? 1 : 0;
+#if USE_BLACKBOX
+    bb_log(BB_EV_BOOT, warm ? 1 : 0, (int32_t)(warm_boot_reset_flags() >> 16), 0, 0);
+#endif
+    DEBUG_PRINT("[BOOT] %s, csr=0x%08lX\r\n", boot_kind, (unsigned long)warm_boot_reset_flags());
+    return;
+  }
+
+  // 上一杯的配置参数只是变量，恢复无副作用（CONFIGURE 会重新计算）
+  x_param = snap.x;
+  t1_param = snap.t1;
+  y_param = snap.y;
+  t2_param = snap.t2;
+  // 无解析帧复位：传感器本身可能已失常，必须重新初始化
+  warm_skip_init = (snap.state == STATE_DETECT) && (snap.flags & WARM_FLAG_SENSOR_DEFAULT)
+                && (snap.reason != WARM_REASON_NO_PARSE);
+  // 传感器未断电：复位前在 DETECT 时它已是 DETECT 可用的配置，只做开机序列；
+  // 否则可能仍是上一杯的配置，需恢复默认阈值
+  at_boot_init_pending = (snap.state == STATE_DETECT);
+  boot_kind = warm_skip_init ? "warm-skip" : "warm";
+  boot_code = warm_skip_init ? 2 : 1;
+#if USE_BLACKBOX
+  bb_log(BB_EV_BOOT, warm_skip_init ? 2 : 1, (int32_t)(warm_boot_reset_flags() >> 16), 0, 0);
+#endif
+  DEBUG_PRINT("[BOOT] %s, reason=%d, state=%d, flags=0x%X, cfg=%d/%d/%d/%d, csr=0x%08lX\r\n", boot_kind,
+              snap.reason, snap.state, snap.flags, snap.x, snap.t1, snap.y, snap.t2,
+              (unsigned long)warm_boot_reset_flags());
+}
+#endif
+
+#if USE_FLASH_KV
+// 开机：建立键值索引，恢复计数与杯子缓存
+static void kv_restore(void)
+{
+  KvStatus st = kv_init();
+  uint16_t len = sizeof(boot_count);
+  if (kv_get(KV_KEY_BOOT_COUNT, &boot_count, &len) != KV_OK) boot_count = 0;
+  boot_saved = boot_count;
+  // 热复位（看门狗/无解析帧/主动复位）不计；冷启动也等空闲时再写，反复复位时不擦写 Flash
+  if (boot_code == 0) boot_count++;
+
+  len = sizeof(dispense_count);
+  if (kv_get(KV_KEY_DISPENSES, &dispense_count, &len) != KV_OK) dispense_count = 0;
+  dispense_saved = dispense_count;
+
+#if USE_CUP_CACHE
+  int restored = 0;
+  for (int i = 0; i < CUP_CACHE_SIZE; i++) {
+    CupCacheEntry_t *e = &cup_cache.entries[i];
+    len = CUP_CACHE_REC_LEN;
+    if (kv_get(KV_KEY_CUP_BASE + i, e, &len) != KV_OK || len != CUP_CACHE_REC_LEN) {
+      memset(e, 0, sizeof(*e));
+      continue;
+    }
+    restored++;     // hits/stamp 不持久化：开机后恢复的项都视为最久未用
+  }
+#else
+  int restored = 0;
+#endif
+
+  const KvStats_t *ks = kv_stats();
+  DEBUG_PRINT("[KV] init=%d, page=%d, used=%d, keys=%d, torn=%lu, erase=%lu/%lu, boots=%lu, cups=%lu, cached=%d\r\n",
+              st, ks->page, ks->used, ks->keys, (unsigned long)ks->torn, (unsigned long)ks->erase_a,
+              (unsigned long)ks->erase_b, (unsigned long)boot_count, (unsigned long)dispense_count, restored);
+}
+
+// 空闲时保存：擦写会让 CPU 取指停顿（页擦除约 20ms），出水期间不写
+static void job_persist_fn(uint32_t now)
+{
+  (void)now;
+  if (app_state != STATE_DETECT) return;
+
+  for (int i = 0; i < CUP_CACHE_SIZE && cup_cache_dirty; i++) {
+    if (!(cup_cache_dirty & (1u << i))) continue;
+    cup_cache_dirty &= (uint8_t)~(1u << i);
+    kv_put(KV_KEY_CUP_BASE + i, &cup_cache.entries[i], CUP_CACHE_REC_LEN);
+  }
+  if (dispense_count != dispense_saved) {
+    dispense_saved = dispense_count;
+    kv_put(KV_KEY_DISPENSES, &dispense_count, sizeof(dispense_count));
+  }
+  if (boot_count != boot_saved) {
+    boot_saved = boot_count;
+    kv_put(KV_KEY_BOOT_COUNT, &boot_count, sizeof(boot_count));
+  }
+}
+#endif
+
+#if USE_BLACKBOX
+static void bb_write_uart(const uint8_t *data, uint16_t len)
+{
+  log_write((const char *)data, len);
+}
+#endif
+
+#if USE_BLACKBOX || USE_WARM_BOOT
+// USART2 控制台命令：
+//  'B' 导出黑匣子（上次转储 + 当前缓冲），由 blackbox_decode.py 解码
+//  'R' 空闲（DETECT）时主动复位；传感器为默认配置时重启后跳过初始化（warm-skip）
+static void job_console_fn(uint32_t now)
+{
+  (void)now;
+  if (!__HAL_UART_GET_FLAG(&huart2, UART_FLAG_RXNE)) return;
+  uint8_t c = (uint8_t)(huart2.Instance->DR & 0xFF);
+#if USE_BLACKBOX
+  // 导出阻塞主循环：只在不出水的 DETECT/WAIT 中响应（与 job_persist_fn 的 Flash 写入一样）
+  if (c == 'B' && (app_state == STATE_DETECT || app_state == STATE_WAIT)) bb_dump(bb_write_uart);
+#endif
+#if USE_WARM_BOOT
+  if (c == 'R' && app_state == STATE_DETECT) system_hard_reset(WARM_REASON_USER); // 不会返回
+#endif
+}
+#endif
+
+#if USE_BINARY_TELEMETRY && TLM_REPORT_MS
+// 输出量统计：结构体记录 vs 仍以文本发送的行（文本也计入 TLM_T_TEXT 帧）
+static void job_tlm_report_fn(uint32_t now)
+{
+  (void)now;
+  const TlmStats_t *st = tlm_stats();
+#if USE_DEFERRED_LOG
+  const DlogStats_t *ls = dlog_stats();
+  DEBUG_PRINT("[TLM] packets=%lu payload=%lu B wire=%lu B (%lu ms tx) enc=%lu us; log records=%lu %lu B enc=%lu us\r\n",
+              (unsigned long)st->packets, (unsigned long)st->payload, (unsigned long)st->bytes,
+              (unsigned long)(st->bytes * UART2_US_PER_BYTE / 1000U), (unsigned long)dwt_cycles_to_us(st->enc_cyc),
+              (unsigned long)ls->records, (unsigned long)ls->bytes, (unsigned long)dwt_cycles_to_us(ls->enc_cyc));
+#else
+  DEBUG_PRINT("[TLM] packets=%lu payload=%lu B wire=%lu B (%lu ms tx) enc=%lu us; text lines=%lu %lu B fmt=%lu us\r\n",
+              (unsigned long)st->packets, (unsigned long)st->payload, (unsigned long)st->bytes,
+              (unsigned long)(st->bytes * UART2_US_PER_BYTE / 1000U), (unsigned long)dwt_cycles_to_us(st->enc_cyc),
+              (unsigned long)txt_stats.lines, (unsigned long)txt_stats.bytes,
+              (unsigned long)dwt_cycles_to_us(txt_stats.fmt_cyc));
+#endif
+}
+#endif
+
+#if TEST_MODE_ENABLE
+static void job_test_report_fn(uint32_t now)
+{
+  (void)now;
+  DEBUG_PRINT("\r\n--- Test Report ---\r\n");
+  DEBUG_PRINT("Frames OK: %lu\r\n", test_frame_count);
+  DEBUG_PRINT("Parse fail: %lu\r\n", test_parse_fail);
+  DEBUG_PRINT("a_filtered: %d\r\n", a_filtered);
+  DEBUG_PRINT("State: %d\r\n\r\n", app_state);
+}
+#endif
+
+#if SCHED_REPORT_MS
+// 各任务运行时间统计：次数 / 平均耗时 / 最大耗时 / 最大滞后
+static void job_sched_report_fn(uint32_t now)
+{
+  (void)now;
+  for (int8_t i = 0; i < sched_job_count(); i++) {
+    const SchedJob_t *j = sched_job(i);
+    DEBUG_PRINT("[SCHED] %-8s runs=%lu avg=%lu us max=%lu us late_max=%lu ms\r\n",
+                j->name, (unsigned long)j->runs,
+                (unsigned long)(j->runs ? dwt_cycles_to_us(j->cyc_total / j->runs) : 0),
+                (unsigned long)dwt_cycles_to_us(j->cyc_max), (unsigned long)j->late_max_ms);
+  }
+}
+#endif
+
+#if CPU_REPORT_MS
+// 各状态CPU占用（千分比），统计窗口为上一个报告周期
+static void job_cpu_report_fn(uint32_t now)
+{
+  (void)now;
+  uint32_t act_all = 0, total_all = 0;
+  for (int i = 0; i < STATE_COUNT; i++) {
+    uint32_t total = cpu_active_cyc[i] + cpu_sleep_cyc[i];
+    if (total == 0) continue;
+    DEBUG_PRINT("[CPU] %-9s load=%lu.%lu%% (%lu ms)\r\n", state_table[i].name,
+                (unsigned long)((uint64_t)cpu_active_cyc[i] * 1000 / total / 10),
+                (unsigned long)((uint64_t)cpu_active_cyc[i] * 1000 / total % 10),
+                (unsigned long)(total / (SystemCoreClock / 1000U)));
+    act_all += cpu_active_cyc[i];
+    total_all += total;
+  }
+  if (total_all > 0) {
+    DEBUG_PRINT("[CPU] total     load=%lu.%lu%%\r\n",
+                (unsigned long)((uint64_t)act_all * 1000 / total_all / 10),
+                (unsigned long)((uint64_t)act_all * 1000 / total_all % 10));
+  }
+  memset(cpu_active_cyc, 0, sizeof(cpu_active_cyc));
+  memset(cpu_sleep_cyc, 0, sizeof(cpu_sleep_cyc));
+}
+#endif
+
+/* 注册全部任务并启动常驻任务 */
+static void sched_setup(uint32_t now)
+{
+  sched_init();
+#if !USE_FREERTOS
+  job_ingest      = sched_create("ingest", job_ingest_fn, INGEST_PERIOD_MS);
+  job_at          = sched_create("at", job_at_fn, AT_POLL_MS);
+  job_parse_stale = sched_create("stale", job_parse_stale_fn, PARSE_STALE_MS);
+#endif
+  job_watchdog    = sched_create("wdog", job_watchdog_fn, 0);
+  job_state_timer = sched_create("state", job_state_timer_fn, 0);
+  job_boot        = sched_create("boot", job_boot_fn, 0);
+
+#if !USE_FREERTOS
+  sched_start(job_ingest, now, INGEST_PERIOD_MS); // RTOS 构建中由 ingest 任务负责
+  sched_start(job_parse_stale, now, PARSE_STALE_MS);
+#endif
+  sched_start(job_watchdog, now, NO_PARSE_RESET_MS);
+#if USE_WARM_BOOT
+  sched_start(job_boot, now, warm_skip_init ? 0 : BOOT_DELAY_MS); // 热启动：传感器未断电，无需等待
+#else
+  sched_start(job_boot, now, BOOT_DELAY_MS);
+#endif
+#if TEST_MODE_ENABLE
+  sched_start(sched_create("report", job_test_report_fn, 5000), now, 5000);
+#endif
+#if USE_FLASH_KV
+  job_persist     = sched_create("persist", job_persist_fn, KV_PERSIST_MS);
+  sched_start(job_persist, now, KV_PERSIST_MS);
+#endif
+#if USE_BLACKBOX || USE_WARM_BOOT
+  job_console     = sched_create("console", job_console_fn, BB_CONSOLE_MS);
+  sched_start(job_console, now, BB_CONSOLE_MS);
+#endif
+#if USE_BINARY_TELEMETRY && TLM_REPORT_MS
+  sched_start(sched_create("tlm", job_tlm_report_fn, TLM_REPORT_MS), now, TLM_REPORT_MS);
+#endif
+#if SCHED_REPORT_MS
+  sched_start(sched_create("sched", job_sched_report_fn, SCHED_REPORT_MS), now, SCHED_REPORT_MS);
+#endif
+#if CPU_REPORT_MS
+  sched_start(sched_create("cpu", job_cpu_report_fn, CPU_REPORT_MS), now, CPU_REPORT_MS);
+#endif
+  cpu_mark = dwt_cycles();
+}
+
+/* 空闲一次：关中断后再检查一遍，避免事件在检查与休眠之间到达而睡过头。
+ * PRIMASK=1 时挂起的中断仍能唤醒 WFI，开中断后立即执行其服务程序（计入活动时间）。 */
+static void cpu_idle(void)
+{
+  __disable_irq();
+  if (events_pending() || sched_next_in(HAL_GetTick()) == 0) {
+    __enable_irq();
+    return;
+  }
+  uint32_t t0 = dwt_cycles();
+  cpu_active_cyc[app_state] += t0 - cpu_mark;
+#if USE_WFI_IDLE
+  __WFI();
+#endif
+  uint32_t t1 = dwt_cycles();
+  cpu_sleep_cyc[app_state] += t1 - t0;
+  cpu_mark = t1;
+  __enable_irq();
+}
+
+/* ======================= 状态机框架 ======================= */
+
+static void state_timer_start(uint32_t now, uint32_t ms)
+{
+  sched_start(job_state_timer, now, ms);
+}
+
+/* 进入初始状态 */
+static void fsm_start(uint32_t now)
+{
+  app_state = STATE_DETECT;
+  state_enter_ms = now;
+  state_visits[STATE_DETECT]++;
+  state_table[STATE_DETECT].on_entry(now);
+}
+
+/* 状态切换：执行退出/进入动作，并记录停留时间 */
+static void fsm_transition(AppState next, uint32_t now)
+{
+  AppState prev = app_state;
+  uint32_t dwell = now - state_enter_ms;
+
+  if (state_table[prev].on_exit) state_table[prev].on_exit(now);
+
+  state_dwell_ms[prev] += dwell;
+  state_visits[next]++;
+#if USE_BLACKBOX
+  bb_log(BB_EV_STATE, (uint8_t)next, prev, (int32_t)dwell, 0);
+#endif
+#if USE_BINARY_TELEMETRY
+  TlmState_t ts = { (uint8_t)prev, (uint8_t)next, dwell };
+  tlm_send(TLM_T_STATE, &ts, sizeof(ts));
+#else
+  DEBUG_PRINT("[FSM] %s -> %s @%lu ms, dwell=%lu ms (total %lu ms / %lu visits)\r\n",
+              state_table[prev].name, state_table[next].name, (unsigned long)now,
+              (unsigned long)dwell, (unsigned long)state_dwell_ms[prev], (unsigned long)state_visits[prev]);
+#endif
+
+  app_state = next;
+  state_enter_ms = now;
+  sched_cancel(job_state_timer); // 定时器属于旧状态
+
+  if (state_table[next].on_entry) state_table[next].on_entry(now);
+}
+
+/* 分发待处理事件；状态切换后丢弃本批剩余事件（它们属于旧状态） */
+static void fsm_dispatch(uint32_t now)
+{
+  uint32_t ev = ev_take();
+
+  if (ev & EV_FAULT) {
+    pump_stop(); // 转储/复位期间不能继续出水
+    DEBUG_PRINT("[WATCHDOG] No parsed frame for %lu ms, perform %s reset\r\n",
+                (unsigned long)(now - last_parse_ok_ms),
+                (USE_HARD_RESET_ON_NO_PARSE ? "MCU" : "sensor"));
+#if USE_BLACKBOX
+    bb_log(BB_EV_WDOG, USE_HARD_RESET_ON_NO_PARSE, (int32_t)((now - last_parse_ok_ms) / 100), 0, 0);
+    if (!USE_HARD_RESET_ON_NO_PARSE) bb_flush(BB_FLUSH_WDOG); // 整机复位路径在 system_hard_reset 中转储
+#endif
+    if (USE_HARD_RESET_ON_NO_PARSE) {
+      system_hard_reset(WARM_REASON_NO_PARSE); // 不会返回
+    } else {
+      sensor_soft_recover(now); // 仅复位传感器，继续运行
+      last_parse_ok_ms = now; // 避免立刻再次触发
+      sched_start(job_watchdog, now, NO_PARSE_RESET_MS);
+    }
+    return;
+  }
+
+#if !TEST_MODE_ENABLE  // 正常模式才运行状态机
+  static const uint32_t order[] = { EV_AT_DONE, EV_TIMER, EV_FRAME };
+  for (uint32_t i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+    if (!(ev & order[i])) continue;
+    AppState before = app_state;
+    state_table[app_state].on_event(order[i], now);
+    if (app_state != before) break;
+  }
+#endif
+}
+
+/* ======================= 各状态 ======================= */
+
+/* ---- DETECT ---- */
+static void detect_entry(uint32_t now)
+{
+  (void)now;
+  HAL_GPIO_WritePin(GPIOA, GPIO_PIN_6, GPIO_PIN_RESET);
+  HAL_GPIO_WritePin(GPIOA, GPIO_PIN_7, GPIO_PIN_RESET);
+
+#if USE_WARM_BOOT
+  if (warm_skip_init) {
+    // 热启动：传感器仍是默认配置，直接等帧；超时无帧再补做初始化
+    warm_skip_init = false;
+    warm_probe = true;
+    state_timer_start(now, WARM_PROBE_MS);
+  } else {
+    warm_probe = false;
+    sensor_cfg_default = false;
+    at_queue_sensor_init();
+  }
+#else
+  at_queue_sensor_init();
+#endif
+
+  select_a_window(16);
+  debounce_init(&state_deb, DETECT_HOLD_MS, DETECT_MIN_FRAMES);
+  cup_sprt_reset(&cup_sprt);
+  current_frame.valid = false;
   stop_distance = 0;
   require_strong_echo = false;
+  stop_err_pending = false; // 杯子在液面平稳前被取走，放弃本次误差统计
+}
 
-  app_state = STATE_DETECT;
+static void detect_event(uint32_t ev, uint32_t now)
+{
+#if USE_WARM_BOOT
+  if (ev & EV_AT_DONE) {
+    sensor_cfg_default = sensor_cfg_pending; // 开机序列或默认配置下发完成
+    sensor_cfg_pending = false;
+  }
+  if (warm_probe && (ev & EV_FRAME) && frame_seq > 0) {
+    // 跳过初始化后收到帧：传感器确实仍是默认配置，之后的复位可以继续跳过
+    warm_probe = false;
+    sensor_cfg_default = true;
+    sched_cancel(job_state_timer);
+  } else if (warm_probe && (ev & EV_TIMER)) {
+    DEBUG_PRINT("[BOOT] No frame %d ms after warm start, full sensor init\r\n", WARM_PROBE_MS);
+    warm_probe = false;
+    boot_kind = "warm";
+    boot_code = 1;
+    at_queue_sensor_defaults();
+  }
+#endif
+  if (!(ev & EV_FRAME) || !current_frame.valid) return;
+
+#if USE_SPRT_DETECT
+  // 证据明确时几帧即可判定，读数模糊时自动多等
+  SprtDecision d = cup_sprt_update(&cup_sprt, current_frame.a, current_frame.b);
+  if (cup_sprt.frames == 1) sprt_test_ms = frame_ts_ms;
+  if (d == SPRT_CUP) {
+    DEBUG_PRINT("[DETECT->CONFIGURE] SPRT cup! (%d frames / %lu ms, llr=%ld)\r\n",
+                cup_sprt.frames, (unsigned long)(frame_ts_ms - sprt_test_ms), (long)cup_sprt.llr);
+    cup_detect_ms = now; // 出水耗时起点
+    fsm_transition(STATE_CONFIGURE, now);
+    return;
+  }
+#else
+  if (debounce_update(&state_deb, a_filtered < THRESH_DETECT_STOP, frame_seq, frame_ts_ms)) {
+    DEBUG_PRINT("[DETECT->CONFIGURE] Confirmed! (%d frames / %lu ms)\r\n",
+                state_deb.frames, (unsigned long)debounce_held_ms(&state_deb, frame_ts_ms));
+    cup_detect_ms = now; // 出水耗时起点
+    fsm_transition(STATE_CONFIGURE, now);
+    return;
+  }
+#endif
+
+  current_frame.valid = false;
 }
+
+/* ---- CONFIGURE：计算阈值并下发，AT 完成后进入下一状态 ---- */
+static bool cfg_has_container = false;
+
+static void configure_entry(uint32_t now)
+{
+#if USE_WARM_BOOT
+  sensor_cfg_default = false; // 即将下发杯子配置
+  sensor_cfg_pending = false;
+#endif
+  at_enqueue(200, "AT+STOP\r\n");
+
+  // 调用超声波阈值算法
+  ThresholdResult_t thresh_result;
+  compute_thresholds(current_frame.s, S_COUNT, &thresh_result);
+  uint8_t cache_hit = 0;
+
+#if !USE_BINARY_TELEMETRY  // 二进制遥测：结果在参数计算完成后以一条 TLM_T_THRESH 发送
+  DEBUG_PRINT("\r\n=== CONFIGURE RESULT ===\r\n");
+  DEBUG_PRINT("edge_idx: %d\r\n", thresh_result.edge_idx);
+  DEBUG_PRINT("liquid_idx: %d\r\n", thresh_result.liquid_idx);
+  DEBUG_PRINT("x: %d\r\n", thresh_result.x);
+  DEBUG_PRINT("t1: %d\r\n", thresh_result.t1);
+  DEBUG_PRINT("y: %d\r\n", thresh_result.y);
+  DEBUG_PRINT("t2: %d\r\n", thresh_result.t2);
+  DEBUG_PRINT("peak_count: %d\r\n", thresh_result.peak_count);
+  DEBUG_PRINT("edge_extension: %d\r\n", thresh_result.edge_extension); // <-- 新增打印
+  DEBUG_PRINT("sep: %d, prom: %d%%/%d%%, t1_headroom: %d, confidence: %d\r\n",
+              thresh_result.sep, thresh_result.edge_prom_pct, thresh_result.liquid_prom_pct,
+              thresh_result.t1_headroom, thresh_result.confidence);
+#endif
+
+  // 检查是否检测到容器
+  cfg_has_container = !(thresh_result.edge_idx < 0 || thresh_result.liquid_idx < 0);
+  if (!cfg_has_container) {
+    DEBUG_PRINT("[CONFIGURE] No container detected, skip to WAIT\r\n");
+    stop_distance = 0; // <-- 无容器时重置，避免旧值残留
+#if USE_BINARY_TELEMETRY
+    tlm_thresh(&thresh_result, 0);
+#else
+    DEBUG_PRINT("========================\r\n\r\n");
+#endif
+    cfg_sig_pending = false;
+    at_enqueue(500, "AT+REBOOT\r\n");
+    return;
+  }
+
+#if USE_CUP_CACHE
+  // 指纹命中：沿用该杯上次的最终参数（含 VERIFY 调整过的 t1）
+  cup_sig_from_result(&thresh_result, &cfg_sig);
+  CupCacheEntry_t *cached = cup_cache_find(&cup_cache, &cfg_sig);
+  if (cached) {
+    cache_hit = 1;
+    thresh_result.x = cached->x;
+    thresh_result.t1 = cached->t1;
+    thresh_result.y = cached->y;
+    thresh_result.t2 = cached->t2;
+    thresh_result.edge_extension = cached->edge_extension;
+    DEBUG_PRINT("[CACHE] Hit: x=%d, t1=%d, y=%d, t2=%d, stop=%d, hits=%d (%lu/%lu)\r\n",
+                cached->x, cached->t1, cached->y, cached->t2, cached->stop_distance, cached->hits,
+                (unsigned long)cup_cache.hits, (unsigned long)cup_cache.lookups);
+  } else {
+    DEBUG_PRINT("[CACHE] Miss: edge=%d/%d, liquid=%d/%d, peaks=%d\r\n", cfg_sig.edge_idx, cfg_sig.edge_amp,
+                cfg_sig.liquid_idx, cfg_sig.liquid_amp, cfg_sig.peak_count);
+  }
+  cfg_edge_extension = thresh_result.edge_extension;
+  cfg_sig_pending = true;
+#endif
+
+#if USE_LIQUID_TRACKER
+  liquid_tracker_init(&liquid_trk, &thresh_result, now);
+#endif
+
+  // 计算参数
+  x_param = thresh_result.x;
+  t1_param = thresh_result.t1;
+  y_param = thresh_result.y;
+  t2_param = thresh_result.t2;
+  edge_distance = (int)((thresh_result.edge_idx * 430) / 225);
+  cup_depth = (int)(((thresh_result.liquid_idx - thresh_result.edge_idx) * 430) / 225);
+  // [新逻辑] 计算VERIFY阶段要使用的距离阈值 (来自 x_param)
+  alarm_distance_check = (int)((x_param * 430) / 225);
+
+#if !USE_BINARY_TELEMETRY
+  DEBUG_PRINT("Calculated edge_distance: %d, cup_depth: %d\r\n", edge_distance, cup_depth);
+  // [新逻辑] 打印VERIFY的阈值
+  DEBUG_PRINT("Calculated alarm_distance_check: %d\r\n", alarm_distance_check);
+#endif
+
+  // [新逻辑] 计算 stop_distance
+  if (thresh_result.edge_extension == 0) {
+    stop_distance = (int)(((x_param + 1) * 430) / 225);
+  } else {
+    stop_distance = edge_distance + 20;
+  }
+  // 新增：在 edge_extension==0 时启用强回波校验
+  require_strong_echo = (thresh_result.edge_extension == 0);
+#if USE_CUP_CACHE
+  if (cached) stop_distance = cached->stop_distance;
+#endif
+#if USE_BINARY_TELEMETRY
+  tlm_thresh(&thresh_result, cache_hit);
+#else
+  (void)cache_hit;
+  DEBUG_PRINT("Calculated stop_distance: %d, strong_echo_check=%d\r\n", stop_distance, require_strong_echo);
+  DEBUG_PRINT("========================\r\n\r\n");
+#endif
+
+  at_enqueue(500, "AT+S3=%d\r\n", x_param);
+  at_enqueue(500, "AT+S4=%d\r\n", y_param);
+  at_enqueue(500, "AT+T2=%d\r\n", t1_param);
+  at_enqueue(500, "AT+T3=%d\r\n", t2_param);
+  at_enqueue(500, "AT+REBOOT\r\n");
+
+  // 按置信度决定验证强度
+  last_confidence = thresh_result.confidence;
+  if (last_confidence >= CONF_SKIP_VERIFY) {
+    verify_count_target = 0;
+  } else {
+    bool fast = (last_confidence >= CONF_FAST_VERIFY);
+    verify_count_target = fast ? VERIFY_MIN_FRAMES_FAST : VERIFY_MIN_FRAMES;
+    verify_hold_ms = fast ? VERIFY_HOLD_FAST_MS : VERIFY_HOLD_MS;
+  }
+#if USE_CUP_CACHE
+  // 已知杯子：参数在这只杯子上验证过，只做缩短验证
+  if (cached && verify_count_target > VERIFY_MIN_FRAMES_FAST) {
+    verify_count_target = VERIFY_MIN_FRAMES_FAST;
+    verify_hold_ms = VERIFY_HOLD_FAST_MS;
+  }
+#endif
+}
+
+static void configure_event(uint32_t ev, uint32_t now)
+{
+  if (!(ev & EV_AT_DONE)) return;
+
+  if (!cfg_has_container) {
+    fsm_transition(STATE_WAIT, now);
+  } else if (verify_count_target == 0) {
+    DEBUG_PRINT("[CONFIGURE->MEASURE] confidence=%d, skip VERIFY\r\n", last_confidence);
+    fsm_transition(STATE_MEASURE, now);
+  } else {
+    DEBUG_PRINT("[CONFIGURE->VERIFY] confidence=%d, verify=%lu ms / %d frames\r\n",
+                last_confidence, (unsigned long)verify_hold_ms, verify_count_target);
+    fsm_transition(STATE_VERIFY, now);
+  }
+}
+
+/* ---- VERIFY ---- */
+static void verify_entry(uint32_t now)
+{
+  select_a_window(3); // 验证和测量阶段使用快速均值
+  debounce_init(&verify_deb, verify_hold_ms, (uint8_t)verify_count_target); // [新逻辑] 重置验证确认
+  verify_win_count = 0;
+  verify_fail_count = 0;
+  verify_fail_b_max = 0;
+  verify_reconfig_count = 0;
+  verify_enter_ms = now;
+  current_frame.valid = false;
+
+  HAL_GPIO_WritePin(GPIOA, GPIO_PIN_7, GPIO_PIN_SET);
+
+#if USE_SPECULATIVE_START && (USE_PWM_MODE == 1)
+  // 配置结果可信：低速出水，剩余验证与出水并行
+  spec_handover = false;
+  if (last_confidence >= SPEC_MIN_CONFIDENCE) {
+    pump_set_duty(SPEC_DUTY);
+    pump_start();
+    spec_running = true;
+    spec_starts++;
+    spec_start_ms = now;
+#if USE_REMOVAL_ABORT
+    removal_guard_start(); // 出水期间同样需要取杯保护（中断侧与主循环侧）
+#endif
+    DEBUG_PRINT("[SPEC] Pump started at duty %d (conf=%d)\r\n", SPEC_DUTY, last_confidence);
+  }
+#endif
+}
+
+// 离开VERIFY：除非交给 MEASURE，否则预先启动的水泵必须停止
+static void verify_exit(uint32_t now)
+{
+  (void)now;
+  if (spec_running && !spec_handover) spec_abort("left VERIFY");
+  spec_running = false;
+}
+
+// 预先启动的水泵立即停止（验证失败当帧）
+static void spec_abort(const char *why)
+{
+  pump_stop();
+#if USE_FAST_CUTOFF
+  fast_cutoff_disarm(); // 水泵已停，取消取杯保护
+#endif
+  spec_running = false;
+  spec_aborts++;
+  DEBUG_PRINT("[SPEC] Abort (%s), aborts=%lu/%lu (%lu%%)\r\n", why,
+              (unsigned long)spec_aborts, (unsigned long)spec_starts,
+              (unsigned long)(spec_aborts * 100 / spec_starts));
+}
+
+static void verify_event(uint32_t ev, uint32_t now)
+{
+  if (ev & EV_AT_DONE) {
+    // t1 重新下发完成：丢弃配置期间的残帧
+    current_frame.valid = false;
+    return;
+  }
+  if (!(ev & EV_FRAME)) return;
+#if USE_REMOVAL_ABORT
+  // 预先出水中：先按原始 a/b 检查取杯（远距离回波不能当作验证通过）
+  if (spec_running) {
+    bool valid = current_frame.valid;
+    if (removal_check(now)) return;
+    current_frame.valid = valid; // removal_check 会消费该帧，验证仍需使用
+  }
+#endif
+  if (!current_frame.valid) return;
+
+  int raw_a = current_frame.a;
+  int raw_b = current_frame.b;
+  current_frame.valid = false;
+
+  // 检查：原始a值是否 < 我们根据x设置的距离阈值
+  // 如果是，说明t1阈值被边沿噪声突破了
+  if (raw_a <= alarm_distance_check) {
+    // 失败：检测到回波 < 设定值
+    debounce_update(&verify_deb, 0, frame_seq, frame_ts_ms);
+    if (spec_running) spec_abort("verify failed"); // 之后等完整验证通过才出水
+#if VERIFY_SINGLE_SHOT_CAL
+    // 先只记录样本，窗口满后按统计一次性标定
+    verify_fail_count++;
+    if (raw_b > verify_fail_b_max) verify_fail_b_max = raw_b;
+    DEBUG_PRINT("[VERIFY] Failed! a=%d < %d, b=%d (fail %d)\r\n",
+                raw_a, alarm_distance_check, raw_b, verify_fail_count);
+#else
+    DEBUG_PRINT("[VERIFY] Failed! a=%d < %d. Adjusting T1.\r\n", raw_a, alarm_distance_check);
+
+    // 按要求增加阈值 = b + 50
+    if (raw_b > t1_param){
+      t1_param = raw_b + 50;
+    }
+    else {
+      t1_param += 20; // 保底增加20
+    }
+    verify_apply_t1();
+    return; // 失败帧不参与本轮确认
+#endif
+  } else {
+    // 成功：未检测到突破
+    debounce_update(&verify_deb, 1, frame_seq, frame_ts_ms);
+    DEBUG_PRINT("[VERIFY] OK (%d/%d, %lu/%lu ms). a=%d\r\n", verify_deb.frames, verify_count_target,
+                (unsigned long)debounce_held_ms(&verify_deb, frame_ts_ms), (unsigned long)verify_hold_ms, raw_a);
+  }
+
+#if VERIFY_SINGLE_SHOT_CAL
+  // 窗口内出现过突破：取失败样本 b 的最大值 + 裕量，只下发一次配置
+  if (verify_fail_count > 0 && ++verify_win_count >= VERIFY_CAL_WINDOW) {
+    if (verify_fail_b_max > t1_param) {
+      t1_param = verify_fail_b_max + VERIFY_CAL_MARGIN;
+    } else {
+      t1_param += 20; // 保底增加20
+    }
+    verify_apply_t1();
+    return;
+  }
+#endif
+
+  if (debounce_confirmed(&verify_deb, frame_ts_ms)) {
+    // 持续确认成功，进入测量
+    DEBUG_PRINT("[VERIFY->MEASURE] Verification complete!\r\n");
+    DEBUG_PRINT("[METRIC] verify: reconfig=%d, duration=%lu ms, t1=%d\r\n",
+                verify_reconfig_count, (unsigned long)(now - verify_enter_ms), t1_param);
+    spec_handover = spec_running;
+    fsm_transition(STATE_MEASURE, now);
+  }
+}
+
+// VERIFY：下发新的 t1（AT+T2）并重启传感器，重新开始验证
+static void verify_apply_t1(void)
+{
+  verify_reconfig_count++;
+  DEBUG_PRINT("[VERIFY] New t1_param = %d (reconfig %d)\r\n", t1_param, verify_reconfig_count);
+#if USE_BLACKBOX
+  bb_log(BB_EV_VERIFY, (uint8_t)verify_reconfig_count, t1_param, verify_fail_b_max, 0);
+#endif
+
+  at_enqueue(200, "AT+STOP\r\n");
+  at_enqueue(500, "AT+T2=%d\r\n", t1_param); // 重新配置T1 (对应AT+T2)
+  at_enqueue(150, "AT+REBOOT\r\n");
+
+  // 重置确认与窗口
+  debounce_reset(&verify_deb);
+  verify_win_count = 0;
+  verify_fail_count = 0;
+  verify_fail_b_max = 0;
+}
+
+/* ---- MEASURE ---- */
+// 进入MEASURE：重置计数与均值，启动水泵，并记录出水耗时
+static void measure_entry(uint32_t now)
+{
+  debounce_init(&state_deb, MEASURE_HOLD_MS, MEASURE_MIN_FRAMES); // 重置停泵确认
+  select_a_window(3);       // 测量阶段使用3点均值（已有历史，无预热）
+  measure_enter_ms = now;   // 记录进入时间，刚开始降敏
+  measure_armed = false;
+  grace_settle_count = 0;
+  grace_seq = frame_seq;
+  state_timer_start(now, MEASURE_GRACE_MS); // 硬上限
+  fill_rate_reset(&fill_rate);
+  stop_lead = 0;
+  current_frame.valid = false;
+#if USE_CUP_CACHE
+  // 验证通过（或跳过）：记录本杯最终参数
+  if (cfg_sig_pending) {
+    cfg_sig_pending = false;
+    CupCacheEntry_t *e = cup_cache_store(&cup_cache, &cfg_sig, x_param, t1_param, y_param, t2_param,
+                                         stop_distance, cfg_edge_extension);
+    DEBUG_PRINT("[CACHE] Stored slot %d: t1=%d, stop=%d\r\n",
+                (int)(e - cup_cache.entries), t1_param, stop_distance);
+    cup_cache_dirty |= (uint8_t)(1u << (e - cup_cache.entries));
+  }
+#endif
+  dispense_count++;
+#if USE_REMOVAL_ABORT
+  removal_guard_start();
+#endif
+  HAL_GPIO_WritePin(GPIOA, GPIO_PIN_7, GPIO_PIN_SET);
+#if (USE_PWM_MODE == 1) && USE_FLOW_CONTROL
+  pump_set_duty(flow_ctrl_start(&flow_ctrl, now)); // 软启动
+  flow_seq = frame_seq;
+#endif
+  pump_start();
+
+  // 预先启动的水泵已在出水：首次出水时间按预先启动时刻计，只统计交接成功的
+  if (spec_handover) {
+    spec_handover = false;
+    ttd_record(2, spec_start_ms);
+    return;
+  }
+  ttd_record((verify_count_target < VERIFY_MIN_FRAMES) ? 1 : 0, now);
+}
+
+// 首次出水耗时：完整验证、跳过/缩短验证、预先启动分开累计，便于对比节省的时间
+static void ttd_record(int path, uint32_t now)
+{
+  uint32_t ttd = now - cup_detect_ms;
+  ttd_sum_ms[path] += ttd;
+  ttd_cnt[path]++;
+#if USE_BINARY_TELEMETRY
+  tlm_metric(TLM_M_TTD, (int32_t)ttd, path); // 均值由上位机统计
+#else
+  DEBUG_PRINT("[METRIC] time_to_first_water=%lu ms, conf=%d, verify=%d, avg_full=%lu, avg_fast=%lu, avg_spec=%lu\r\n",
+              (unsigned long)ttd, last_confidence, verify_count_target,
+              (unsigned long)(ttd_cnt[0] ? ttd_sum_ms[0] / ttd_cnt[0] : 0),
+              (unsigned long)(ttd_cnt[1] ? ttd_sum_ms[1] / ttd_cnt[1] : 0),
+              (unsigned long)(ttd_cnt[2] ? ttd_sum_ms[2] / ttd_cnt[2] : 0));
+#endif
+}
+
+// 结束降敏：记录每杯的降敏时间与原因
+static void measure_arm(uint32_t now, const char *why)
+{
+  uint32_t armed_at = now - measure_enter_ms;
+  measure_armed = true;
+  sched_cancel(job_state_timer);
+  armed_sum_ms += armed_at;
+  armed_cnt++;
+#if USE_BINARY_TELEMETRY
+  tlm_metric(TLM_M_ARMED_AT, (int32_t)armed_at, cup_depth);
+  (void)why;
+#else
+  DEBUG_PRINT("[METRIC] armed_at=%lu ms (%s), depth=%d, avg=%lu ms, cap=%d ms\r\n",
+              (unsigned long)armed_at, why, cup_depth,
+              (unsigned long)(armed_sum_ms / armed_cnt), MEASURE_GRACE_MS);
+#endif
+}
+
+// 离开MEASURE（无论何种原因）：水泵必须停止
+static void measure_exit(uint32_t now)
+{
+  pump_stop();
+#if USE_FAST_CUTOFF
+  fast_cutoff_disarm();
+#endif
+#if (USE_PWM_MODE == 1) && USE_FLOW_CONTROL
+  DEBUG_PRINT("[FLOW] fill=%lu ms, full_duty=%lu ms, avg_duty=%lu, final_duty=%d\r\n",
+              (unsigned long)(now - flow_ctrl.start_ms), (unsigned long)flow_ctrl.full_ms,
+              (unsigned long)(flow_ctrl.frames ? flow_ctrl.duty_sum / flow_ctrl.frames : 0),
+              flow_ctrl.duty);
+#endif
+  liquid_trk.locked = 0; // 本杯结束，停止跟踪
+  measure_armed = false;
+}
+
+static void measure_event(uint32_t ev, uint32_t now)
+{
+  if ((ev & EV_TIMER) && !measure_armed) {
+    measure_arm(now, "cap"); // 降敏时间窗达到上限
+  }
+  if (!(ev & EV_FRAME)) return;
+
+#if USE_REMOVAL_ABORT
+  if (removal_check(now)) return; // 先于降敏与停泵判断，降敏期同样有效
+#endif
+
+#if USE_ADAPTIVE_GRACE
+  // 自适应结束降敏：溅射瞬态平稳（新息小且液位峰跟踪稳定），或达到按杯深估算的时间
+  if (!measure_armed && frame_seq != grace_seq) {
+    grace_seq = frame_seq;
+    uint32_t elapsed = now - measure_enter_ms;
+#if USE_KALMAN_DISTANCE
+    int innov = kalman_dist_innovation(&a_kf);
+#else
+    int innov = last_a - a_filtered;
+#endif
+    bool settled = (innov <= GRACE_INNOV_MAX && innov >= -GRACE_INNOV_MAX);
+#if USE_HAMPEL_GATE
+    settled = settled && !a_rejected; // 被剔除的离群帧说明仍有溅射，且新息未更新
+#endif
+#if USE_LIQUID_TRACKER
+    settled = settled && liquid_trk.locked;
+#endif
+    grace_settle_count = settled ? (uint8_t)(grace_settle_count + 1) : 0;
+
+    uint32_t depth_ms = (cup_depth > 0) ? (uint32_t)cup_depth * GRACE_MS_PER_DEPTH : MEASURE_GRACE_MS;
+    if (elapsed >= GRACE_MIN_MS) {
+      if (grace_settle_count >= GRACE_SETTLE_FRAMES) {
+        measure_arm(now, "settled");
+      } else if (elapsed >= depth_ms) {
+        measure_arm(now, "depth");
+      }
+    }
+  }
+#endif
+
+#if (USE_PWM_MODE == 1) && USE_FLOW_CONTROL
+  // 每个新帧按剩余距离调节一次占空
+  if (flow_seq != frame_seq && a_bank.count > 0) {
+    flow_seq = frame_seq;
+    pump_set_duty(flow_ctrl_update(&flow_ctrl, a_filtered - (stop_distance + stop_lead), now));
+  }
+#endif
+
+  bool do_stop = false;
+  int b_threshold = t1_param / 3;
+
+#if USE_FAST_CUTOFF
+  // 中断侧已关断水泵：这里只完成后续状态切换
+  if (fast_cutoff_fired()) {
+    const FastCutoffStats_t *fs = fast_cutoff_stats();
+    DEBUG_PRINT("[FASTCUT] Pump off in ISR, latency=%lu us (min=%lu, max=%lu, n=%lu, rejected=%lu)\r\n",
+                (unsigned long)dwt_cycles_to_us(fs->last), (unsigned long)dwt_cycles_to_us(fs->min),
+                (unsigned long)dwt_cycles_to_us(fs->max), (unsigned long)fs->count,
+                (unsigned long)fs->rejected);
+    do_stop = true;
+  }
+#endif
+
+  if (!do_stop && ma_bank_ready(&a_bank, a_ma_tap)) { // a_ma_window 此时为 3
+    // 新增：组合触发条件
+#if USE_PREDICTIVE_STOP
+    stop_lead = predict_stop_lead();
+#endif
+    bool stop_cond = (a_filtered < stop_distance + stop_lead);
+#if USE_LIQUID_TRACKER
+    // 第二路信号：跟踪到的液位峰已越过停止距离。只有与 a_filtered 相差在
+    // TRACK_AGREE_TOL 内时才采信（即 a_filtered 已接近停止点），跟踪器单独不能触发停泵
+    if (liquid_trk.locked) {
+      int trk_d = liquid_tracker_distance(&liquid_trk);
+      int trk_diff = trk_d - a_filtered;
+      if (trk_diff < 0) trk_diff = -trk_diff;
+      bool track_cond = (trk_d < stop_distance + stop_lead)
+                        && (trk_diff <= TRACK_AGREE_TOL);
+      stop_cond = stop_cond || track_cond;
+    }
+#endif
+    if (require_strong_echo) {
+      stop_cond = stop_cond && (last_b > b_threshold);
+    }
+
+#if USE_FAST_CUTOFF
+    // 降敏期结束后，把本估计器对下一帧的停泵门限（换算成原始 a）同步给中断侧，
+    // 两条路径在同一液位触发；回波强度按最近一帧估计
+    if (measure_armed) {
+#if USE_KALMAN_DISTANCE
+      uint8_t pred_below;
+      int cut_a = kalman_dist_stop_threshold(&a_kf, stop_distance + stop_lead, last_b,
+                                             frame_ts_ms + frame_interval_ms, &pred_below);
+      int cut_reject = pred_below ? FAST_CUTOFF_ALWAYS : FAST_CUTOFF_NEVER; // 剔除帧只做预测
+#else
+      int cut_a = ma_bank_stop_threshold(&a_bank, a_ma_tap, stop_distance + stop_lead);
+      int cut_reject = cut_a; // 剔除帧以中位数计入均值
+#endif
+      fast_cutoff_arm(cut_a, cut_reject, b_threshold, require_strong_echo, MEASURE_MIN_FRAMES);
+    }
+#endif
+
+    // 只有新帧才计入确认（同一帧的重复事件不计数）
+    if (debounce_update(&state_deb, measure_armed && stop_cond, frame_seq, frame_ts_ms)) {
+      DEBUG_PRINT("[MEASURE->WAIT] ALERT ON! a_f=%d < %d+%d, b=%d > %d, strong=%d\r\n",
+                  a_filtered, stop_distance, stop_lead, last_b, b_threshold, require_strong_echo);
+      do_stop = true;
+    }
+  }
+
+  if (!do_stop) return;
+
+  pump_stop();
+#if USE_FAST_CUTOFF
+  if (!fast_cutoff_fired()) {
+    // 主循环路径的停泵延迟，用于与中断路径对比
+    DEBUG_PRINT("[FASTCUT] Main-loop stop latency=%lu us\r\n",
+                (unsigned long)dwt_cycles_to_us(dwt_cycles() - fast_cutoff_last_frame_cycles()));
+  }
+#endif
+
+#if USE_BLACKBOX
+  bb_log(BB_EV_STOP, USE_FAST_CUTOFF && fast_cutoff_fired(), a_filtered, stop_distance, stop_lead);
+#endif
+
+  // 记录停泵，进入WAIT后统计平稳液面误差
+  stop_err_pending = true;
+  stop_ms = now;
+  stop_target = stop_distance;
+
+  // 保留 S3/T2/S4，仅恢复 T3 并重启，WAIT 阶段继续观察液面
+  at_enqueue(100, "AT+STOP\r\n");
+  at_enqueue(200, "AT+T3=250\r\n");
+  at_enqueue(500, "AT+REBOOT\r\n");
+
+  fsm_transition(STATE_WAIT, now);
+}
+
+/* ---- WAIT ---- */
+static void wait_entry(uint32_t now)
+{
+  (void)now;
+  HAL_GPIO_WritePin(GPIOA, GPIO_PIN_7, GPIO_PIN_RESET);
+  HAL_GPIO_WritePin(GPIOA, GPIO_PIN_6, GPIO_PIN_SET);
+
+  select_a_window(16);
+  debounce_init(&state_deb, WAIT_HOLD_MS, WAIT_MIN_FRAMES);
+  current_frame.valid = false;
+}
+
+static void wait_event(uint32_t ev, uint32_t now)
+{
+  if (!(ev & EV_FRAME)) return;
+
+  // 停泵误差：液面平稳后取8点均值（窗口完全落在停泵之后）
+  if (stop_err_pending && (now - stop_ms) >= STOP_SETTLE_MS) {
+    stop_error_record(ma_bank_get(&a_bank, ma_bank_tap(8)));
+  }
+
+  if (!current_frame.valid) return;
+
+  if (debounce_update(&state_deb, a_filtered > THRESH_MEASURE_HIGH, frame_seq, frame_ts_ms)) {
+    DEBUG_PRINT("[WAIT->DETECT] Reset!\r\n");
+    fsm_transition(STATE_DETECT, now);
+    return;
+  }
+
+  current_frame.valid = false;
+}
+
+/* ---- 取杯保护 ---- */
+// 水泵启动时调用（MEASURE，或 VERIFY 预先出水）：比杯底更远（不超过空腔阈值），或回波明显变弱
+static void removal_guard_start(void)
+{
+  removal_distance = edge_distance + cup_depth + REMOVAL_MARGIN;
+  if (removal_distance > THRESH_MEASURE_HIGH) removal_distance = THRESH_MEASURE_HIGH;
+  removal_b_lost = t1_param / REMOVAL_B_LOST_DIV;
+  removal_lost_count = 0;
+  removal_seq = frame_seq;
+#if USE_FAST_CUTOFF
+  fast_cutoff_guard(removal_distance, removal_b_lost, REMOVAL_LOST_FRAMES);
+#endif
+}
+
+// 主循环侧：按原始 a/b 判断（不经过门限与均值）；中断侧已停泵时只完成状态切换
+static bool removal_check(uint32_t now)
+{
+  int why = 0;
+#if USE_FAST_CUTOFF
+  why = fast_cutoff_removed();
+#endif
+  if (!why && frame_seq != removal_seq) {
+    removal_seq = frame_seq;
+    if (last_a > removal_distance) {
+      why = 1;
+    } else if (current_frame.valid && last_b < removal_b_lost) {
+      // 只有完整帧才有 b
+      if (++removal_lost_count >= REMOVAL_LOST_FRAMES) why = 2;
+    } else {
+      removal_lost_count = 0;
+    }
+    current_frame.valid = false; // 该帧的 b 已判断
+  }
+  if (!why) return false;
+
+  pump_stop();
+  removal_cnt++;
+#if USE_BLACKBOX
+  bb_log(BB_EV_REMOVAL, (uint8_t)why, last_a, last_b, (int32_t)((now - state_enter_ms) / 100));
+#endif
+#if USE_FAST_CUTOFF
+  if (fast_cutoff_removed()) {
+    const FastCutoffStats_t *rs = fast_cutoff_removal_stats();
+    DEBUG_PRINT("[METRIC] removal: %s in ISR, latency=%lu us (min=%lu, max=%lu, n=%lu)\r\n",
+                (why == 1) ? "far" : "lost",
+                (unsigned long)dwt_cycles_to_us(rs->last), (unsigned long)dwt_cycles_to_us(rs->min),
+                (unsigned long)dwt_cycles_to_us(rs->max), (unsigned long)rs->count);
+  } else {
+    DEBUG_PRINT("[METRIC] removal: %s in main loop, latency=%lu us\r\n", (why == 1) ? "far" : "lost",
+                (unsigned long)dwt_cycles_to_us(dwt_cycles() - fast_cutoff_last_frame_cycles()));
+  }
+#else
+  DEBUG_PRINT("[METRIC] removal: %s in main loop, latency=%lu ms\r\n", (why == 1) ? "far" : "lost",
+              (unsigned long)(now - frame_ts_ms));
+#endif
+  DEBUG_PRINT("[%s->ABORT] Cup removed! a=%d > %d or b=%d < %d, filled=%lu ms, n=%lu\r\n",
+              state_table[app_state].name, last_a, removal_distance, last_b, removal_b_lost,
+              (unsigned long)(now - state_enter_ms), (unsigned long)removal_cnt);
+  fsm_transition(STATE_ABORT, now);
+  return true;
+}
+
+/* ---- ABORT ---- */
+// 清理：水泵已由 measure_exit/verify_exit 停止；停止传感器测量，不统计停泵误差，稍后回到 DETECT 恢复默认配置
+static void abort_entry(uint32_t now)
+{
+  HAL_GPIO_WritePin(GPIOA, GPIO_PIN_7, GPIO_PIN_RESET);
+  HAL_GPIO_WritePin(GPIOA, GPIO_PIN_6, GPIO_PIN_SET);
+
+  stop_err_pending = false;
+  at_enqueue(100, "AT+STOP\r\n");
+  state_timer_start(now, ABORT_SETTLE_MS);
+}
+
+static void abort_event(uint32_t ev, uint32_t now)
+{
+  if (!(ev & EV_TIMER)) return;
+  DEBUG_PRINT("[ABORT->DETECT] Cleanup done\r\n");
+  fsm_transition(STATE_DETECT, now);
+}
+
+/* ======================= 其他 ======================= */
+
+// 预测停泵提前量 = |注水速率| * 端到端延迟
+// 延迟 = 滤波群延迟(均值为(N-1)/2帧，卡尔曼为0) + 确认窗口(含 Hampel 阶跃延迟) + 轮询延迟 + 水泵断流时间
+static int predict_stop_lead(void)
+{
+  int32_t slope;
+  if (!fill_rate_slope(&fill_rate, &slope) || slope >= 0) return 0; // 液面未上升
+
+  uint32_t confirm_ms = frame_interval_ms * (MEASURE_MIN_FRAMES - 1);
+#if MEASURE_HOLD_MS > 0
+  if (confirm_ms < MEASURE_HOLD_MS) confirm_ms = MEASURE_HOLD_MS;
+#endif
+#if USE_HAMPEL_GATE
+  confirm_ms += frame_interval_ms * HAMPEL_STEP_LAG; // 阶跃首帧被门限拒绝
+#endif
+#if USE_KALMAN_DISTANCE
+  uint32_t filter_ms = 0; // 匀速模型跟踪斜坡无稳态滞后
+#else
+  uint32_t filter_ms = frame_interval_ms * (a_ma_window - 1) / 2;
+#endif
+  uint32_t latency_ms = filter_ms
+                      + confirm_ms
+                      + POLL_LATENCY_MS + PUMP_SPINDOWN_MS;
+  int32_t lead = (-slope * (int32_t)latency_ms) / 1000;
+  if (lead > PREDICT_MAX_LEAD) lead = PREDICT_MAX_LEAD;
+  return (int)lead;
+}
+
+// 记录一次停泵误差并打印分布
+static void stop_error_record(int settled_a)
+{
+  stop_err_pending = false;
+  int err = stop_target - settled_a;
+
+  int bin = (err + 20) / STOP_ERR_BIN_W;
+  if (err < -20) bin = 0;
+  if (bin < 0) bin = 0;
+  if (bin >= STOP_ERR_BINS) bin = STOP_ERR_BINS - 1;
+  stop_err_hist[bin]++;
+  stop_err_sum += err;
+  stop_err_cnt++;
+#if USE_BINARY_TELEMETRY
+  tlm_metric(TLM_M_STOP_ERROR, err, stop_lead); // 分布由上位机统计
+#else
+  DEBUG_PRINT("[METRIC] stop_error=%d (target=%d, settled=%d, lead=%d, predictive=%d), mean=%ld, n=%d\r\n",
+              err, stop_target, settled_a, stop_lead, USE_PREDICTIVE_STOP,
+              (long)(stop_err_sum / stop_err_cnt), stop_err_cnt);
+  DEBUG_PRINT("[METRIC] stop_error_hist(-20..+25 step %d): %d %d %d %d %d %d %d %d %d\r\n", STOP_ERR_BIN_W,
+              stop_err_hist[0], stop_err_hist[1], stop_err_hist[2], stop_err_hist[3], stop_err_hist[4],
+              stop_err_hist[5], stop_err_hist[6], stop_err_hist[7], stop_err_hist[8]);
+#endif
+}
+
+// [新增] 整机软件复位：等效于按下硬复位（由 NVIC 触发）
+static void system_hard_reset(uint16_t reason)
+{
+  pump_stop(); // Flash 转储期间 CPU 停顿，先停泵
+#if USE_WARM_BOOT
+  // 传感器不随 MCU 复位：记下它当前的配置，重启后据此决定能否跳过初始化
+  WarmSnapshot_t snap = {
+    reason, (uint16_t)app_state, sensor_cfg_default ? WARM_FLAG_SENSOR_DEFAULT : 0,
+    (int16_t)x_param, (int16_t)t1_param, (int16_t)y_param, (int16_t)t2_param
+  };
+  warm_boot_save(&snap);
+#else
+  (void)reason;
+#endif
+#if USE_BLACKBOX
+  bb_flush(BB_FLUSH_RESET);
+#endif
+  DEBUG_PRINT("[RESET] NVIC_SystemReset(), reason=%d\r\n", reason);
+  HAL_Delay(5); // 尽量把日志发出去
+  NVIC_SystemReset();
+}
+
+// [新增] 仅复位传感器与控制状态：丢弃进行中的AT序列，回到DETECT（其进入动作恢复默认阈值）
+static void sensor_soft_recover(uint32_t now)
+{
+  DEBUG_PRINT("[WATCHDOG] Soft sensor recovery\r\n");
+  at_reset();
+  fsm_transition(STATE_DETECT, now);
+}
+#if USE_FREERTOS
+/* ======================= RTOS 任务 ======================= */
+
+/* ingest：DMA 数据与帧解析，结果经 frame_queue 交给 control。
+ * 只访问解析缓冲与 DMA 读指针，不与其他任务共享状态；空闲中断通知或 INGEST_PERIOD_MS 兜底唤醒 */
+static void task_ingest(void *arg)
+{
+  (void)arg;
+  bool was_busy = false;
+  uint32_t last_ok_ms = HAL_GetTick();
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(INGEST_PERIOD_MS));
+    uint32_t now = HAL_GetTick();
+
+    if (uart_restart_req) {
+      uart_restart_req = false;
+      uart_rx_restart();
+    }
+
+    // AT 序列进行中收到的是 OK/回显：直接丢弃，序列结束时再丢一次残留的半帧
+    if (at_busy || was_busy) {
+      was_busy = at_busy;
+      dma_rx_flush();
+      clear_parse_buffer();
+      continue;
+    }
+
+    static FrameMsg msg; // 任务栈有限：消息体放在静态区（仅本任务使用），解析结果直接写入
+    uint8_t r = ingest_parse(&msg.frame);
+    if (r & INGEST_FULL) last_ok_ms = now;
+    if ((r & INGEST_OVERFLOW) || (parse_len > 0 && now - last_ok_ms >= PARSE_STALE_MS)) {
+      if (parse_len > 0) clear_parse_buffer(); // 长时间没有成功解析：丢弃残帧
+      last_ok_ms = now;
+    }
+    if (!(r & (INGEST_FULL | INGEST_A_ONLY))) continue;
+
+    msg.result = r;
+    msg.t_ms = now;
+    if (xQueueSend(frame_queue, &msg, 0) != pdPASS) {
+      frame_drop_count++;
+    } else {
+      xTaskNotifyGive(task_control_h);
+    }
+  }
+}
+
+/* 取出 ingest 送来的一帧，写入 current_frame 并处理 */
+static bool control_take_frame(void)
+{
+  static FrameMsg msg;
+  if (xQueueReceive(frame_queue, &msg, 0) != pdPASS) return false;
+  current_frame.a = msg.frame.a;
+  if (msg.result & INGEST_FULL) {
+    current_frame = msg.frame;
+  }
+  frame_apply(msg.result, msg.t_ms);
+  return true;
+}
+
+/* control：帧处理、调度任务（超时/状态定时器）与状态机，唯一访问控制状态的任务；
+ * 每帧处理后立即运行状态机，无事可做时阻塞到下一个到期时间 */
+static void task_control(void *arg)
+{
+  (void)arg;
+  for (;;) {
+    uint32_t now = HAL_GetTick();
+    drain_isr_events(now);
+    if (control_take_frame()) fsm_dispatch(HAL_GetTick()); // 每帧一次 EV_FRAME，不合并
+    now = HAL_GetTick();
+    sched_run(now);
+    if (ev_pending) fsm_dispatch(now);
+    if (events_pending() || uxQueueMessagesWaiting(frame_queue) > 0) continue;
+
+    uint32_t wait = sched_next_in(HAL_GetTick());
+    // 通知计数会保留：检查之后到达的事件也能立即唤醒
+    ulTaskNotifyTake(pdTRUE, (wait == SCHED_IDLE) ? portMAX_DELAY : pdMS_TO_TICKS(wait));
+  }
+}
+
+/* 发送一条 AT 命令并等待 OK 或超时；只在 config 任务中运行，阻塞的串口收发不持有任何锁 */
+static bool at_exchange(const AtCmd *c)
+{
+  at_ok_len = 0;
+  at_ok_pos = dma_get_pos();
+  uint32_t start = HAL_GetTick();
+  send_at("%s", c->cmd);
+  for (;;) {
+    // 空闲中断（SPSC_EV_AT_RESPONSE）经 control 转发通知，AT_POLL_MS 兜底
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(AT_POLL_MS));
+    if (at_ok_scan()) {
+      DEBUG_PRINT("[AT] OK received\r\n");
+      return true;
+    }
+    if (HAL_GetTick() - start >= c->timeout_ms) {
+      DEBUG_PRINT("[AT] OK timeout\r\n");
+      return false;
+    }
+  }
+}
+
+/* config：从 at_cmd_queue 取命令依次发送；序列（队列取空）完成后投递 EV_AT_DONE */
+static void task_config(void *arg)
+{
+  (void)arg;
+  uint8_t cmds = 0, fails = 0;
+  for (;;) {
+    AtCmd c;
+    xQueueReceive(at_cmd_queue, &c, portMAX_DELAY);
+    uint8_t gen = at_gen;
+    if (cmds == 0) fails = 0;
+
+    bool ok = at_exchange(&c);
+
+    taskENTER_CRITICAL();
+    bool stale = (gen != at_gen); // 期间被 at_reset 丢弃
+    bool done = false;
+    if (!stale && at_pending > 0) {
+      at_pending--;
+      done = (at_pending == 0);
+      if (done) at_busy = false;
+    }
+    taskEXIT_CRITICAL();
+
+    if (stale) {
+      cmds = 0;
+      continue;
+    }
+    cmds++;
+    if (!ok) {
+      fails++;
+#if USE_BLACKBOX
+      bb_log(BB_EV_AT, 1, cmds - 1, fails, 0);
+#endif
+    }
+    if (done) {
+#if USE_BLACKBOX
+      bb_log(BB_EV_AT, 0, cmds, fails, 0);
+#endif
+      cmds = 0;
+      ev_post(EV_AT_DONE); // 半帧由 ingest 在 at_busy 清除后丢弃
+    }
+  }
+}
+
+static void rtos_report(void)
+{
+  DEBUG_PRINT("[RTOS] stack free(words) ing=%lu ctl=%lu cfg=%lu tel=%lu\r\n",
+              (unsigned long)uxTaskGetStackHighWaterMark(task_ingest_h),
+              (unsigned long)uxTaskGetStackHighWaterMark(task_control_h),
+              (unsigned long)uxTaskGetStackHighWaterMark(task_config_h),
+              (unsigned long)uxTaskGetStackHighWaterMark(task_telemetry_h));
+  DEBUG_PRINT("[RTOS] heap free=%lu min=%lu (total %lu), log_drop=%lu, frame_drop=%lu\r\n",
+              (unsigned long)xPortGetFreeHeapSize(),
+              (unsigned long)xPortGetMinimumEverFreeHeapSize(),
+              (unsigned long)configTOTAL_HEAP_SIZE,
+              (unsigned long)log_drop_count, (unsigned long)frame_drop_count);
+}
+
+/* telemetry：唯一使用 USART2 的任务，最低优先级；定期报告栈/堆水位 */
+static void task_telemetry(void *arg)
+{
+  (void)arg;
+  LogLine line;
+  TickType_t last_report = xTaskGetTickCount();
+  for (;;) {
+    if (xQueueReceive(log_queue, &line, pdMS_TO_TICKS(RTOS_REPORT_MS)) == pdPASS) {
+      HAL_UART_Transmit(&huart2, (uint8_t*)line.text, line.len, 100);
+    }
+    if ((xTaskGetTickCount() - last_report) >= pdMS_TO_TICKS(RTOS_REPORT_MS)) {
+      last_report = xTaskGetTickCount();
+      rtos_report(); // 经 log_queue 输出（与其他日志一样成帧）
+    }
+  }
+}
+
+/* 创建队列与任务并启动内核 */
+static void app_rtos_start(void)
+{
+  log_queue = xQueueCreate(LOG_QUEUE_LEN, sizeof(LogLine));
+  frame_queue = xQueueCreate(FRAME_QUEUE_LEN, sizeof(FrameMsg));
+  at_cmd_queue = xQueueCreate(AT_QUEUE_MAX, sizeof(AtCmd));
+  if (log_queue == NULL || frame_queue == NULL || at_cmd_queue == NULL) Error_Handler();
+
+  if (xTaskCreate(task_control, "control", RTOS_STACK_CONTROL, NULL, RTOS_PRIO_CONTROL, &task_control_h) != pdPASS ||
+      xTaskCreate(task_ingest, "ingest", RTOS_STACK_INGEST, NULL, RTOS_PRIO_INGEST, &task_ingest_h) != pdPASS ||
+      xTaskCreate(task_config, "config", RTOS_STACK_CONFIG, NULL, RTOS_PRIO_CONFIG, &task_config_h) != pdPASS ||
+      xTaskCreate(task_telemetry, "telem", RTOS_STACK_TELEMETRY, NULL, RTOS_PRIO_TELEMETRY, &task_telemetry_h) != pdPASS) {
+    Error_Handler();
+  }
+
+  vTaskStartScheduler();
+  Error_Handler(); // 堆不足以创建空闲任务
+}
+
+void vApplicationStackOverflowHook(TaskHandle_t task, char *name)
+{
+  (void)task;
+  (void)name;
+  pump_hw_off(); // 先保证水泵关闭
+  Error_Handler();
+}
+
+void vApplicationMallocFailedHook(void)
+{
+  pump_hw_off();
+  Error_Handler();
+}
+#endif /* USE_FREERTOS */
+
 /* USER CODE END 4 */
 
 /**
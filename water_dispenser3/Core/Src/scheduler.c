@@ -0,0 +1,114 @@
+#include "scheduler.h"
+#include "dwt_timer.h"
+#include <string.h>
+
+static SchedJob_t jobs[SCHED_MAX_JOBS];
+static int8_t job_count = 0;
+static int8_t head = SCHED_NO_JOB;   // 最早到期的任务
+
+// 回绕安全的时间比较：a 早于 b
+static inline int time_before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+static void list_remove(int8_t id) {
+    int8_t *pp = &head;
+    while (*pp != SCHED_NO_JOB) {
+        if (*pp == id) {
+            *pp = jobs[id].next;
+            break;
+        }
+        pp = &jobs[*pp].next;
+    }
+    jobs[id].next = SCHED_NO_JOB;
+}
+
+// 按到期时间插入；同一时间的任务保持先来先执行
+static void list_insert(int8_t id) {
+    int8_t *pp = &head;
+    while (*pp != SCHED_NO_JOB && !time_before(jobs[id].deadline, jobs[*pp].deadline)) {
+        pp = &jobs[*pp].next;
+    }
+    jobs[id].next = *pp;
+    *pp = id;
+}
+
+void sched_init(void) {
+    memset(jobs, 0, sizeof(jobs));
+    job_count = 0;
+    head = SCHED_NO_JOB;
+    dwt_init();
+}
+
+int8_t sched_create(const char *name, SchedFn fn, uint32_t period_ms) {
+    if (job_count >= SCHED_MAX_JOBS || fn == NULL) return SCHED_NO_JOB;
+    int8_t id = job_count++;
+    jobs[id].name = name;
+    jobs[id].fn = fn;
+    jobs[id].period_ms = period_ms;
+    jobs[id].next = SCHED_NO_JOB;
+    return id;
+}
+
+void sched_start(int8_t id, uint32_t now, uint32_t delay_ms) {
+    if (id < 0 || id >= job_count) return;
+    if (jobs[id].active) list_remove(id);
+    jobs[id].deadline = now + delay_ms;
+    jobs[id].active = 1;
+    list_insert(id);
+}
+
+void sched_cancel(int8_t id) {
+    if (id < 0 || id >= job_count || !jobs[id].active) return;
+    list_remove(id);
+    jobs[id].active = 0;
+}
+
+uint8_t sched_active(int8_t id) {
+    if (id < 0 || id >= job_count) return 0;
+    return jobs[id].active;
+}
+
+uint32_t sched_run(uint32_t now) {
+    // 每次只取链表头：任务内可能启动/取消其他任务
+    while (head != SCHED_NO_JOB && !time_before(now, jobs[head].deadline)) {
+        int8_t id = head;
+        SchedJob_t *j = &jobs[id];
+
+        list_remove(id);
+        uint32_t late = now - j->deadline;
+        if (j->period_ms > 0) {
+            // 周期任务按原节拍推进；落后超过一个周期则从当前时间重新对齐
+            j->deadline += j->period_ms;
+            if (time_before(j->deadline, now)) j->deadline = now + j->period_ms;
+            list_insert(id);
+        } else {
+            j->active = 0;
+        }
+
+        uint32_t c0 = dwt_cycles();
+        j->fn(now);
+        uint32_t cyc = dwt_cycles() - c0;
+
+        j->runs++;
+        j->cyc_total += cyc;
+        if (cyc > j->cyc_max) j->cyc_max = cyc;
+        if (late > j->late_max_ms) j->late_max_ms = late;
+    }
+    return sched_next_in(now);
+}
+
+uint32_t sched_next_in(uint32_t now) {
+    if (head == SCHED_NO_JOB) return SCHED_IDLE;
+    if (!time_before(now, jobs[head].deadline)) return 0;
+    return jobs[head].deadline - now;
+}
+
+const SchedJob_t *sched_job(int8_t id) {
+    if (id < 0 || id >= job_count) return NULL;
+    return &jobs[id];
+}
+
+int8_t sched_job_count(void) {
+    return job_count;
+}
@@ -0,0 +1,49 @@
+#include "spsc_queue.h"
+#include <string.h>
+
+/*
+ * 发布顺序：生产者先写数据再写 head，消费者先读 head 再读数据，读完才写 tail。
+ * Cortex-M3 单核上内存访问按程序顺序完成，DMB 主要阻止编译器/总线重排；
+ * 主机构建（Tools/Algo_Simulation/spsc_stress.c 多线程压力测试）使用 GCC 原子栅栏。
+ */
+#if defined(__arm__)
+#include "stm32f1xx.h"
+#define SPSC_BARRIER()  __DMB()
+#else
+#define SPSC_BARRIER()  __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+void spsc_init(SpscQueue_t *q) {
+    memset(q, 0, sizeof(SpscQueue_t));
+}
+
+uint8_t spsc_push(SpscQueue_t *q, const SpscEvent_t *ev) {
+    uint32_t head = q->head;
+    uint32_t depth = head - q->tail;
+
+    if (depth >= SPSC_CAPACITY) {
+        q->overflow++;
+        return 0;
+    }
+    q->buf[head & SPSC_MASK] = *ev;
+    SPSC_BARRIER();         // 数据写完后再发布
+    q->head = head + 1;
+
+    if (depth + 1 > q->high_water) q->high_water = depth + 1;
+    return 1;
+}
+
+uint8_t spsc_pop(SpscQueue_t *q, SpscEvent_t *ev) {
+    uint32_t tail = q->tail;
+
+    if (tail == q->head) return 0;
+    SPSC_BARRIER();         // 看到 head 之后再读数据
+    *ev = q->buf[tail & SPSC_MASK];
+    SPSC_BARRIER();         // 数据读完后才释放槽位
+    q->tail = tail + 1;
+    return 1;
+}
+
+uint8_t spsc_empty(const SpscQueue_t *q) {
+    return q->tail == q->head;
+}
@@ -22,6 +22,7 @@
 #include "stm32f1xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "blackbox.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -85,7 +86,8 @@ void NMI_Handler(void)
 void HardFault_Handler(void)
 {
   /* USER CODE BEGIN HardFault_IRQn 0 */
-
+  pump_stop();              // 先停泵：转储要擦写 Flash，之后停在这里
+  bb_flush(BB_FLUSH_FAULT); // 保存事件记录供事后分析
   /* USER CODE END HardFault_IRQn 0 */
   while (1)
   {
@@ -219,6 +221,11 @@ void DMA1_Channel5_IRQHandler(void)
 void USART1_IRQHandler(void)
 {
   /* USER CODE BEGIN USART1_IRQn 0 */
+  // 帧结束（线路空闲）：在中断里做快速停泵判断
+  if (__HAL_UART_GET_FLAG(&huart1, UART_FLAG_IDLE) && __HAL_UART_GET_IT_SOURCE(&huart1, UART_IT_IDLE)) {
+    __HAL_UART_CLEAR_IDLEFLAG(&huart1);
+    app_uart1_idle_isr();
+  }
 
   /* USER CODE END USART1_IRQn 0 */
   HAL_UART_IRQHandler(&huart1);
@@ -0,0 +1,97 @@
+#include "telemetry.h"
+#include "main.h"
+#include "dwt_timer.h"
+#include <string.h>
+
+static void (*write_fn)(const uint8_t *data, uint16_t len) = NULL;
+static uint8_t tx_seq = 0;
+static TlmStats_t stats;
+
+// CRC-8，多项式 0x07
+static uint8_t crc8(const uint8_t *p, uint16_t n) {
+    uint8_t crc = 0;
+    while (n--) {
+        crc ^= *p++;
+        for (uint8_t i = 0; i < 8; i++) {
+            crc = (crc & 0x80U) ? (uint8_t)((crc << 1) ^ 0x07U) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+// COBS 编码：输出不含 0x00，返回编码长度
+static uint16_t cobs_encode(const uint8_t *src, uint16_t len, uint8_t *dst) {
+    uint16_t code_pos = 0, o = 1;
+    uint8_t code = 1;
+    for (uint16_t i = 0; i < len; i++) {
+        if (src[i] == 0) {
+            dst[code_pos] = code;
+            code_pos = o++;
+            code = 1;
+        } else {
+            dst[o++] = src[i];
+            if (++code == 0xFF) {
+                dst[code_pos] = code;
+                code_pos = o++;
+                code = 1;
+            }
+        }
+    }
+    dst[code_pos] = code;
+    return o;
+}
+
+void tlm_init(void (*write)(const uint8_t *data, uint16_t len)) {
+    write_fn = write;
+    memset(&stats, 0, sizeof(stats));
+}
+
+uint16_t tlm_encode(uint8_t type, uint8_t seq, uint32_t t_ms, const void *payload, uint16_t len, uint8_t *out) {
+    if (len > TLM_MAX_PAYLOAD) return 0;
+
+    uint8_t raw[TLM_HDR_LEN + TLM_MAX_PAYLOAD + 1];
+    raw[0] = type;
+    raw[1] = seq;
+    raw[2] = (uint8_t)t_ms;
+    raw[3] = (uint8_t)(t_ms >> 8);
+    raw[4] = (uint8_t)(t_ms >> 16);
+    raw[5] = (uint8_t)(t_ms >> 24);
+    memcpy(&raw[TLM_HDR_LEN], payload, len);
+    raw[TLM_HDR_LEN + len] = crc8(raw, (uint16_t)(TLM_HDR_LEN + len));
+
+    uint16_t n = cobs_encode(raw, (uint16_t)(TLM_HDR_LEN + len + 1), out);
+    out[n++] = 0x00;
+    return n;
+}
+
+void tlm_send(uint8_t type, const void *payload, uint16_t len) {
+    uint8_t frame[TLM_MAX_FRAME];
+    uint32_t t0 = dwt_cycles();
+
+    // 多个上下文（RTOS 任务）都可能发送：序号在关中断下分配
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint8_t seq = tx_seq++;
+    __set_PRIMASK(primask);
+
+    uint16_t n = tlm_encode(type, seq, HAL_GetTick(), payload, len, frame);
+    if (n == 0) return;
+    stats.enc_cyc += dwt_cycles() - t0;
+    stats.packets++;
+    stats.payload += len;
+    stats.bytes += n;
+    if (write_fn) write_fn(frame, n);
+}
+
+void tlm_text(const char *s, uint16_t len) {
+    while (len > 0) {
+        uint16_t n = (len < TLM_MAX_PAYLOAD) ? len : TLM_MAX_PAYLOAD;
+        tlm_send(TLM_T_TEXT, s, n);
+        s += n;
+        len -= n;
+    }
+}
+
+const TlmStats_t *tlm_stats(void) {
+    return &stats;
+}
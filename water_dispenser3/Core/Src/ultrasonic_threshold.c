@@ -184,6 +184,42 @@ static void classify_peaks(Peak_t *peaks, uint8_t count, int16_t valid_len,
     }
 }
 
+// 分项得分：value/full 线性映射到 0~100
+static int16_t score_pct(int32_t value, int32_t full) {
+    if (value <= 0 || full <= 0) return 0;
+    if (value >= full) return 100;
+    return (int16_t)((value * 100) / full);
+}
+
+// 置信度：间隔、显著性、t1 余量三项取最小（任何一项薄弱都不应跳过验证）
+// edge_amp 为平滑后的边沿簇幅度：t1 = 1.15 * edge_amp，设计余量即 t1 - edge_amp
+static void compute_confidence(const int16_t *raw_data, const Peak_t *edge, const Peak_t *liquid,
+                               int16_t edge_amp, ThresholdResult_t *result) {
+    // 液位峰与 x 的间隔（全局索引）
+    result->sep = (int16_t)(liquid->idx + MIN_I - result->x);
+
+    result->edge_prom_pct   = (int16_t)((int32_t)edge->prominence * 100 / (edge->amp > 0 ? edge->amp : 1));
+    result->liquid_prom_pct = (int16_t)((int32_t)liquid->prominence * 100 / (liquid->amp > 0 ? liquid->amp : 1));
+
+    // t1 对 [MIN_I, x] 内最强“原始”采样的余量：传感器按原始值比较，平滑会低估毛刺
+    int16_t raw_max = 0;
+    for (int16_t i = MIN_I; i <= result->x && i <= MAX_I; i++) {
+        raw_max = max_i16(raw_max, raw_data[i]);
+    }
+    result->t1_headroom = (int16_t)(result->t1 - raw_max);
+
+    int16_t s_sep  = score_pct(result->sep, CONF_SEP_FULL);
+    int16_t s_prom = score_pct(min_i16(result->edge_prom_pct, result->liquid_prom_pct), CONF_PROM_FULL_PCT);
+    // 原始峰值本来就高于平滑幅度（5 点平滑削峰），余量按占设计余量的比例评分
+    int32_t margin = (int32_t)result->t1 - edge_amp;
+    int16_t s_head = score_pct((int32_t)result->t1_headroom * 100 / (margin > 0 ? margin : 1),
+                               CONF_HEADROOM_FULL_PCT);
+
+    int16_t conf = min_i16(s_sep, min_i16(s_prom, s_head));
+    if (result->edge_extension && conf > CONF_EXTENSION_CAP) conf = CONF_EXTENSION_CAP;
+    result->confidence = (uint8_t)conf;
+}
+
 static void set_no_container_defaults(ThresholdResult_t *result) {
     result->edge_idx = -1;
     result->liquid_idx = -1;
@@ -193,6 +229,7 @@ static void set_no_container_defaults(ThresholdResult_t *result) {
     result->y  = 152;
     result->peak_count = 0;
     result->edge_extension = 0; // 新增：默认未扩展
+    result->confidence = 0;     // 无容器：不可信
 }
 
 void compute_thresholds(const int16_t *raw_data, int16_t raw_len, ThresholdResult_t *result) {
@@ -360,4 +397,81 @@ void compute_thresholds(const int16_t *raw_data, int16_t raw_len, ThresholdResul
     } else if (result->y == result->x) {
         result->y = (int16_t)(result->y + 1);
     }
-}
\ No newline at end of file
+
+    // 裕量与置信度
+    compute_confidence(raw_data, edge, liquid, edge_cluster_amp, result);
+}
+
+/* ---------------- 液位回波跟踪 ---------------- */
+
+void liquid_tracker_init(LiquidTracker_t *trk, const ThresholdResult_t *result, uint32_t now_ms) {
+    memset(trk, 0, sizeof(LiquidTracker_t));
+    if (result->edge_idx < 0 || result->liquid_idx < 0) return;
+
+    trk->idx_q = (int32_t)result->liquid_idx * TRACK_Q;
+    trk->start_q = trk->idx_q;
+    trk->full_q = (int32_t)result->x * TRACK_Q;
+    trk->edge_limit = (int16_t)(result->edge_idx + 2);
+    trk->last_ms = now_ms;
+    trk->locked = 1;
+}
+
+// 3 点平滑后的采样（与边界裁剪）
+static inline int32_t sm3(const int16_t *d, int16_t i, int16_t len) {
+    if (i <= 0 || i >= len - 1) return d[i];
+    return ((int32_t)d[i - 1] + 2 * (int32_t)d[i] + d[i + 1]) / 4;
+}
+
+uint8_t liquid_tracker_update(LiquidTracker_t *trk, const int16_t *raw_data, int16_t raw_len, uint32_t now_ms) {
+    if (!trk->locked || raw_data == NULL || raw_len <= MAX_I) return 0;
+
+    int16_t center = (int16_t)(trk->idx_q / TRACK_Q);
+    int16_t lo = max_i16((int16_t)(center - TRACK_SEARCH_LEFT), trk->edge_limit);
+    int16_t hi = min_i16((int16_t)(center + TRACK_SEARCH_RIGHT), MAX_I);
+    if (lo >= hi) lo = (int16_t)(hi - 1);
+
+    // 窗口内找最大值
+    int16_t best = lo;
+    int32_t best_v = sm3(raw_data, lo, raw_len);
+    for (int16_t i = (int16_t)(lo + 1); i <= hi; i++) {
+        int32_t v = sm3(raw_data, i, raw_len);
+        if (v > best_v) { best_v = v; best = i; }
+    }
+
+    if (best_v < TRACK_MIN_AMP) {
+        if (++trk->lost_count > TRACK_LOST_MAX) trk->locked = 0;
+        return 0;
+    }
+    trk->lost_count = 0;
+
+    // 抛物线插值：offset = (y-1 - y+1) / (2*(y-1 - 2*y0 + y+1))
+    int32_t pos_q = (int32_t)best * TRACK_Q;
+    if (best > lo && best < hi) {
+        int32_t ym = sm3(raw_data, (int16_t)(best - 1), raw_len);
+        int32_t yp = sm3(raw_data, (int16_t)(best + 1), raw_len);
+        int32_t den = 2 * (ym - 2 * best_v + yp);
+        if (den < 0) pos_q += ((ym - yp) * TRACK_Q) / den;
+    }
+
+    // 速率：位置减小 = 液面上升；一阶平滑（3/4 旧值 + 1/4 新值）
+    uint32_t dt = now_ms - trk->last_ms;
+    if (dt > 0) {
+        int32_t inst = ((trk->idx_q - pos_q) * 1000) / (int32_t)dt;
+        trk->rate_q = (trk->rate_q * 3 + inst) / 4;
+    }
+    trk->last_ms = now_ms;
+    trk->idx_q = pos_q;
+    trk->amp = (int16_t)best_v;
+
+    // 液位百分比
+    int32_t span = trk->start_q - trk->full_q;
+    if (span > 0) {
+        int32_t pct = ((trk->start_q - pos_q) * 100) / span;
+        trk->level_pct = (int16_t)(pct < 0 ? 0 : (pct > 100 ? 100 : pct));
+    }
+    return 1;
+}
+
+int liquid_tracker_distance(const LiquidTracker_t *trk) {
+    return (int)((trk->idx_q * 430) / (225 * TRACK_Q));
+}
@@ -0,0 +1,72 @@
+#include "warm_boot.h"
+
+// BKP 数据寄存器只用低 16 位
+#define BKP_MAGIC   (BKP->DR1)
+#define BKP_SUM     (BKP->DR9)
+
+static uint32_t reset_csr = 0;
+static uint8_t  warm = 0;
+
+static volatile uint32_t *const snap_regs[7] = {
+    &BKP->DR2, &BKP->DR3, &BKP->DR4, &BKP->DR5, &BKP->DR6, &BKP->DR7, &BKP->DR8
+};
+
+static void snap_to_words(const WarmSnapshot_t *s, uint16_t w[7]) {
+    w[0] = s->reason;
+    w[1] = s->state;
+    w[2] = s->flags;
+    w[3] = (uint16_t)s->x;
+    w[4] = (uint16_t)s->t1;
+    w[5] = (uint16_t)s->y;
+    w[6] = (uint16_t)s->t2;
+}
+
+static uint16_t checksum(const uint16_t w[7]) {
+    uint16_t sum = 0xA5A5U;
+    for (int i = 0; i < 7; i++) sum = (uint16_t)((sum << 1 | sum >> 15) ^ w[i]);
+    return sum;
+}
+
+uint8_t warm_boot_init(void) {
+    __HAL_RCC_PWR_CLK_ENABLE();
+    __HAL_RCC_BKP_CLK_ENABLE();
+    HAL_PWR_EnableBkUpAccess();
+
+    reset_csr = RCC->CSR;
+    __HAL_RCC_CLEAR_RESET_FLAGS();
+
+    // 软件复位与看门狗复位同时会置位 PINRST，以 PORRST 区分上电
+    warm = !(reset_csr & RCC_CSR_PORRSTF) &&
+           (reset_csr & (RCC_CSR_SFTRSTF | RCC_CSR_IWDGRSTF | RCC_CSR_WWDGRSTF)) != 0;
+    return warm;
+}
+
+uint32_t warm_boot_reset_flags(void) {
+    return reset_csr;
+}
+
+uint8_t warm_boot_take(WarmSnapshot_t *s) {
+    uint16_t w[7];
+    for (int i = 0; i < 7; i++) w[i] = (uint16_t)*snap_regs[i];
+
+    uint8_t ok = warm && (uint16_t)BKP_MAGIC == WARM_MAGIC && (uint16_t)BKP_SUM == checksum(w);
+    BKP_MAGIC = 0; // 只用一次：之后的上电/外部复位不会误用旧快照
+    if (!ok) return 0;
+
+    s->reason = w[0];
+    s->state = w[1];
+    s->flags = w[2];
+    s->x = (int16_t)w[3];
+    s->t1 = (int16_t)w[4];
+    s->y = (int16_t)w[5];
+    s->t2 = (int16_t)w[6];
+    return 1;
+}
+
+void warm_boot_save(const WarmSnapshot_t *s) {
+    uint16_t w[7];
+    snap_to_words(s, w);
+    for (int i = 0; i < 7; i++) *snap_regs[i] = w[i];
+    BKP_SUM = checksum(w);
+    BKP_MAGIC = WARM_MAGIC; // 最后写入：其余寄存器写完才生效
+}